@@ -2,6 +2,8 @@
 #include <flecs.h>
 #include "ecsTypes.h"
 #include "raylib.h"
+#include "aiUtils.h"
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
 
@@ -10,67 +12,51 @@ class AttackEnemyState : public State
 public:
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &/*ecs*/, flecs::entity /*entity*/) override {}
+  void act(float/* dt*/, flecs::world &/*ecs*/, flecs::entity /*entity*/) const override {}
 };
 
-template<typename T>
-T sqr(T a){ return a*a; }
-
-template<typename T, typename U>
-static float dist_sq(const T &lhs, const U &rhs) { return float(sqr(lhs.x - rhs.x) + sqr(lhs.y - rhs.y)); }
-
-template<typename T, typename U>
-static float dist(const T &lhs, const U &rhs) { return sqrtf(dist_sq(lhs, rhs)); }
-
-template<typename T, typename U>
-static int move_towards(const T &from, const U &to)
+// Player stats taken once per turn by update_ai_sensors.
+struct PlayerSnapshot
 {
-  int deltaX = to.x - from.x;
-  int deltaY = to.y - from.y;
-  if (abs(deltaX) > abs(deltaY))
-    return deltaX > 0 ? EA_MOVE_RIGHT : EA_MOVE_LEFT;
-  return deltaY < 0 ? EA_MOVE_UP : EA_MOVE_DOWN;
-}
+  float hitpoints = FLT_MAX; // no player, nobody to heal
+};
 
-static int inverse_move(int move)
+// Queries shared by all states and transitions. Creating a query is expensive,
+// so they are made on first use and kept for the lifetime of the world.
+struct AiContext
+{
+  flecs::query<const Position, const Team> teams;
+  flecs::query<const Position, Chest> chests;
+  flecs::query<const IsPlayer, Hitpoints> player;
+  flecs::query<AiSensors, const Position, const Team> sensors;
+  PlayerSnapshot playerSnapshot;
+
+  explicit AiContext(flecs::world &ecs) :
+    teams(ecs.query<const Position, const Team>()),
+    chests(ecs.query<const Position, Chest>()),
+    player(ecs.query<const IsPlayer, Hitpoints>()),
+    sensors(ecs.query<AiSensors, const Position, const Team>())
+  {}
+};
+
+static AiContext &ai_context(flecs::world &ecs)
 {
-  return move == EA_MOVE_LEFT ? EA_MOVE_RIGHT :
-         move == EA_MOVE_RIGHT ? EA_MOVE_LEFT :
-         move == EA_MOVE_UP ? EA_MOVE_DOWN :
-         move == EA_MOVE_DOWN ? EA_MOVE_UP : move;
+  static AiContext context(ecs);
+  return context;
 }
 
-
-template<typename Callable>
-static void on_closest_enemy_pos(flecs::world &ecs, flecs::entity entity, Callable c)
+// one query per tag, shared by the states and transitions looking for it
+template<typename Tag>
+static flecs::query<const Position, const Tag> &tagged_query(flecs::world &ecs)
 {
-  static auto enemiesQuery = ecs.query<const Position, const Team>();
-  entity.set([&](const Position &pos, const Team &t, Action &a)
-  {
-    flecs::entity closestEnemy;
-    float closestDist = FLT_MAX;
-    Position closestPos;
-    enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
-    {
-      if (t.team == et.team)
-        return;
-      float curDist = dist(epos, pos);
-      if (curDist < closestDist)
-      {
-        closestDist = curDist;
-        closestPos = epos;
-        closestEnemy = enemy;
-      }
-    });
-    if (ecs.is_valid(closestEnemy))
-      c(a, pos, closestPos);
-  });
+  static auto query = ecs.query<const Position, const Tag>();
+  return query;
 }
 
 template<typename Tag, typename Callable>
 static void on_closest_tagged_pos(flecs::world &ecs, flecs::entity entity, Callable c)
 {
-  static auto targets = ecs.query<const Position, const Tag>();
+  auto &targets = tagged_query<Tag>(ecs);
   entity.set([&](const Position &pos, Action &a)
   {
     flecs::entity closestTarget;
@@ -96,9 +82,9 @@ class LootResourcesState : public State
 public:
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override
+  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
-    auto chestQuery = ecs.query<const Position&, Chest&>();
+    auto &chestQuery = ai_context(ecs).chests;
     entity.set([&](const Position &pos, Craft &craft)
     {
       chestQuery.each([&](const Position& chest_pos, Chest& chest)
@@ -122,7 +108,7 @@ class CraftState : public State
 public:
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override
+  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
     entity.set([&](const Position &pos, Craft &craft)
     {
@@ -142,15 +128,15 @@ public:
   SleepState(int sleep) : sleepTime(sleep){}
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override {
-    auto chestQuery = ecs.query<Chest&>();
+  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override {
+    auto &chestQuery = ai_context(ecs).chests;
     entity.set([&](Cooldown& cooldown)
     {
       if (cooldown.time <= 0)
       {
         cooldown.time = sleepTime;
       
-        chestQuery.each([&](Chest& chest)
+        chestQuery.each([&](const Position&, Chest& chest)
         {
           chest.items = 0;
         });
@@ -165,7 +151,7 @@ class MoveToTaggedState : public State
 public:
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override
+  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
     on_closest_tagged_pos<Tag>(ecs, entity, [&](Action &a, const Position &pos, const Position &tagged_pos)
     {
@@ -182,7 +168,7 @@ public:
   PatrolTaggedState(float dist) : patrolDist(dist) {}
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override
+  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
     on_closest_tagged_pos<Tag>(ecs, entity, [&](Action &a, const Position &player_pos, const Position &tagged_pos)
     {
@@ -210,16 +196,16 @@ public:
   HealPlayerState(float dist, float heal, int cooldown) : healingDist(dist), healAmount(heal), cooldownTime(cooldown) {}
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override
+  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
-    auto playerQuery = ecs.query<Hitpoints&>();
+    auto &playerQuery = ai_context(ecs).player;
     entity.set([&](const Position &pos, const PatrolPos &ppos, Action &a, Cooldown& cooldown)
     {
       if (dist(pos, ppos) > healingDist)
         a.action = move_towards(pos, ppos);
       else
       {
-        playerQuery.each([&](Hitpoints &health)
+        playerQuery.each([&](const IsPlayer &, Hitpoints &health)
         {
           health.hitpoints += healAmount;
         });
@@ -234,11 +220,12 @@ class MoveToEnemyState : public State
 public:
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override
+  void act(float/* dt*/, flecs::world &, flecs::entity entity) const override
   {
-    on_closest_enemy_pos(ecs, entity, [&](Action &a, const Position &pos, const Position &enemy_pos)
+    entity.set([&](const AiSensors &sensors, const Position &pos, Action &a)
     {
-      a.action = move_towards(pos, enemy_pos);
+      if (sensors.enemyDist < FLT_MAX)
+        a.action = move_towards(pos, sensors.enemyPos);
     });
   }
 };
@@ -249,11 +236,12 @@ public:
   FleeFromEnemyState() {}
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override
+  void act(float/* dt*/, flecs::world &, flecs::entity entity) const override
   {
-    on_closest_enemy_pos(ecs, entity, [&](Action &a, const Position &pos, const Position &enemy_pos)
+    entity.set([&](const AiSensors &sensors, const Position &pos, Action &a)
     {
-      a.action = inverse_move(move_towards(pos, enemy_pos));
+      if (sensors.enemyDist < FLT_MAX)
+        a.action = inverse_move(move_towards(pos, sensors.enemyPos));
     });
   }
 };
@@ -265,7 +253,7 @@ public:
   PatrolState(float dist) : patrolDist(dist) {}
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override
+  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
     entity.set([&](const Position &pos, const PatrolPos &ppos, Action &a)
     {
@@ -287,7 +275,7 @@ public:
   HealState(float amount) : healAmount(amount) {}
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override
+  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
     entity.set([&](const Position &pos, Hitpoints &health, Action &a)
     {
@@ -301,7 +289,7 @@ class NopState : public State
 public:
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) override {}
+  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override {}
 };
 
 class EnemyAvailableTransition : public StateTransition
@@ -309,19 +297,12 @@ class EnemyAvailableTransition : public StateTransition
   float triggerDist;
 public:
   EnemyAvailableTransition(float in_dist) : triggerDist(in_dist) {}
-  bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
+  bool isAvailable(flecs::world &, flecs::entity entity) const override
   {
-    static auto enemiesQuery = ecs.query<const Position, const Team>();
     bool enemiesFound = false;
-    entity.get([&](const Position &pos, const Team &t)
+    entity.get([&](const AiSensors &sensors)
     {
-      enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
-      {
-        if (t.team == et.team)
-          return;
-        float curDist = dist(epos, pos);
-        enemiesFound |= curDist <= triggerDist;
-      });
+      enemiesFound = sensors.enemyDist <= triggerDist;
     });
     return enemiesFound;
   }
@@ -335,7 +316,7 @@ public:
   NearTargetTransition(float in_dist) : triggerDist(in_dist) {}
   bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
   {
-    static auto query = ecs.query<const Position, const Tag>();
+    auto &query = tagged_query<Tag>(ecs);
     bool isNear = false;
     entity.get([&](const Position &pos)
     {
@@ -356,7 +337,7 @@ public:
   bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
   {
     bool isLooted = false;
-    auto chestQuery = ecs.query<const Position&, const Chest&>();
+    auto &chestQuery = ai_context(ecs).chests;
     entity.get([&](const Position& pos, const Craft& craft)
     {
       isLooted |= craft.resources >= craft.itemsToCraft;
@@ -392,7 +373,7 @@ public:
   bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
   {
     bool isFilled = false;
-    auto chestQuery = ecs.query<const Position&, const Chest&>();
+    auto &chestQuery = ai_context(ecs).chests;
     entity.get([&](const Position& pos, const Craft& craft)
     {
       chestQuery.each([&](const Position& chest_pos, const Chest& chest)
@@ -427,27 +408,21 @@ class PlayerHPLessThanTransition : public StateTransition
   float threshold;
 public:
   PlayerHPLessThanTransition(float in_thres) : threshold(in_thres) {}
-  bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
+  bool isAvailable(flecs::world &ecs, flecs::entity) const override
   {
-    auto playerQuery = ecs.query<Hitpoints&>();
-    bool hitpointsThresholdReached = false;
-    playerQuery.each([&](Hitpoints &health)
-    {
-      hitpointsThresholdReached |= health.hitpoints < threshold;
-    });
-    return hitpointsThresholdReached;
+    return ai_context(ecs).playerSnapshot.hitpoints < threshold;
   }
 };
 
 class CooldownReadyTransition : public StateTransition
 {
 public:
-  bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
+  bool isAvailable(flecs::world &, flecs::entity entity) const override
   {
     bool cooldownReady = false;
-    entity.get([&](const Cooldown &cd)
+    entity.get([&](const AiSensors &sensors)
     {
-      cooldownReady |= cd.time <= 0;
+      cooldownReady = sensors.cooldownReady;
     });
     return cooldownReady;
   }
@@ -494,6 +469,36 @@ public:
 };
 
 
+void update_ai_sensors(flecs::world &ecs)
+{
+  AiContext &context = ai_context(ecs);
+  context.playerSnapshot = PlayerSnapshot{};
+  context.player.each([&](const IsPlayer &, const Hitpoints &hp)
+  {
+    context.playerSnapshot.hitpoints = hp.hitpoints;
+  });
+  context.sensors.each([&](flecs::entity entity, AiSensors &sensors, const Position &pos, const Team &t)
+  {
+    sensors.enemyDist = FLT_MAX;
+    context.teams.each([&](const Position &epos, const Team &et)
+    {
+      if (t.team == et.team)
+        return;
+      const float curDist = dist(epos, pos);
+      if (curDist < sensors.enemyDist)
+      {
+        sensors.enemyDist = curDist;
+        sensors.enemyPos = epos;
+      }
+    });
+    sensors.cooldownReady = false;
+    entity.get([&](const Cooldown &cd)
+    {
+      sensors.cooldownReady = cd.time <= 0;
+    });
+  });
+}
+
 // states
 State *create_attack_enemy_state()
 {
@@ -624,4 +629,63 @@ StateTransition *create_near_target_transition(float dist)
 }
 template StateTransition *create_near_target_transition<CraftingTable>(float dist);
 template StateTransition *create_near_target_transition<Chest>(float dist);
-template StateTransition *create_near_target_transition<Bed>(float dist);
\ No newline at end of file
+template StateTransition *create_near_target_transition<Bed>(float dist);
+
+std::shared_ptr<const StateMachineDef> create_berserk_sm_def()
+{
+  auto sm = std::make_shared<StateMachineDef>();
+  int patrol = sm->addState(create_patrol_state(4.f));
+  int moveToEnemy = sm->addState(create_move_to_enemy_state());
+
+  sm->addTransition(create_enemy_available_transition(7.f), patrol, moveToEnemy);
+  sm->addTransition(create_hitpoints_less_than_transition(60.f), patrol, moveToEnemy);
+
+  sm->addTransition(create_and_transition(create_negate_transition(create_enemy_available_transition(7.f)), 
+                    create_negate_transition(create_hitpoints_less_than_transition(60.f))), moveToEnemy, patrol);
+  sm->compile();
+  return sm;
+}
+
+std::shared_ptr<const StateMachineDef> create_healer_sm_def()
+{
+  auto sm = std::make_shared<StateMachineDef>();
+  int patrol = sm->addState(create_patrol_state(4.f));
+  int heal = sm->addState(create_heal_state(10.f));
+
+  sm->addTransition(create_hitpoints_less_than_transition(90.f), patrol, heal);
+  sm->addTransition(create_negate_transition(create_hitpoints_less_than_transition(90.f)), heal, patrol);
+  sm->compile();
+  return sm;
+}
+
+std::shared_ptr<const StateMachineDef> create_patrol_attack_flee_sm_def()
+{
+  auto sm = std::make_shared<StateMachineDef>();
+  int patrol = sm->addState(create_patrol_state(3.f));
+  int moveToEnemy = sm->addState(create_move_to_enemy_state());
+  int fleeFromEnemy = sm->addState(create_flee_from_enemy_state());
+
+  sm->addTransition(create_enemy_available_transition(3.f), patrol, moveToEnemy);
+  sm->addTransition(create_negate_transition(create_enemy_available_transition(5.f)), moveToEnemy, patrol);
+
+  sm->addTransition(create_and_transition(create_hitpoints_less_than_transition(60.f), create_enemy_available_transition(5.f)),
+                    moveToEnemy, fleeFromEnemy);
+  sm->addTransition(create_and_transition(create_hitpoints_less_than_transition(60.f), create_enemy_available_transition(3.f)),
+                    patrol, fleeFromEnemy);
+
+  sm->addTransition(create_negate_transition(create_enemy_available_transition(7.f)), fleeFromEnemy, patrol);
+  sm->compile();
+  return sm;
+}
+
+std::shared_ptr<const StateMachineDef> create_patrol_flee_sm_def()
+{
+  auto sm = std::make_shared<StateMachineDef>();
+  int patrol = sm->addState(create_patrol_state(3.f));
+  int fleeFromEnemy = sm->addState(create_flee_from_enemy_state());
+
+  sm->addTransition(create_enemy_available_transition(3.f), patrol, fleeFromEnemy);
+  sm->addTransition(create_negate_transition(create_enemy_available_transition(5.f)), fleeFromEnemy, patrol);
+  sm->compile();
+  return sm;
+}
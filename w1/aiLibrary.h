@@ -2,6 +2,10 @@
 
 #include "stateMachine.h"
 
+// refreshes AiSensors of all entities and the player snapshot, call once per
+// turn before the machines act
+void update_ai_sensors(flecs::world &ecs);
+
 // states
 State *create_attack_enemy_state();
 State *create_move_to_enemy_state();
@@ -33,3 +37,9 @@ StateTransition *create_filled_chest_transition(int items);
 
 template <typename Tag> StateTransition *create_near_target_transition(float dist);
 
+// archetypes shared by the game and the fsm bench, the same machines as the
+// fsm:: ones in staticAiLibrary.h
+std::shared_ptr<const StateMachineDef> create_berserk_sm_def();
+std::shared_ptr<const StateMachineDef> create_healer_sm_def();
+std::shared_ptr<const StateMachineDef> create_patrol_attack_flee_sm_def();
+std::shared_ptr<const StateMachineDef> create_patrol_flee_sm_def();
@@ -0,0 +1,31 @@
+#pragma once
+#include <cmath>
+#include <cstdlib>
+#include "ecsTypes.h"
+
+template<typename T>
+inline T sqr(T a){ return a*a; }
+
+template<typename T, typename U>
+inline float dist_sq(const T &lhs, const U &rhs) { return float(sqr(lhs.x - rhs.x) + sqr(lhs.y - rhs.y)); }
+
+template<typename T, typename U>
+inline float dist(const T &lhs, const U &rhs) { return sqrtf(dist_sq(lhs, rhs)); }
+
+template<typename T, typename U>
+inline int move_towards(const T &from, const U &to)
+{
+  int deltaX = to.x - from.x;
+  int deltaY = to.y - from.y;
+  if (abs(deltaX) > abs(deltaY))
+    return deltaX > 0 ? EA_MOVE_RIGHT : EA_MOVE_LEFT;
+  return deltaY < 0 ? EA_MOVE_UP : EA_MOVE_DOWN;
+}
+
+inline int inverse_move(int move)
+{
+  return move == EA_MOVE_LEFT ? EA_MOVE_RIGHT :
+         move == EA_MOVE_RIGHT ? EA_MOVE_LEFT :
+         move == EA_MOVE_UP ? EA_MOVE_DOWN :
+         move == EA_MOVE_DOWN ? EA_MOVE_UP : move;
+}
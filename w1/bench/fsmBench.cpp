@@ -0,0 +1,152 @@
+// Headless benchmark of the virtual StateMachine against the compile time fsm::Machine,
+// ticked per entity from a variant or per state from (CurrentState, S) tags
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <flecs.h>
+#include "aiLibrary.h"
+#include "ecsTypes.h"
+#include "stateMachine.h"
+#include "staticAiLibrary.h"
+
+static uint32_t hash(uint32_t x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+struct BenchAgent {};
+
+enum BenchEngine
+{
+  BE_VIRTUAL,
+  BE_STATIC,
+  BE_TAGS
+};
+
+template<typename MachineType>
+static void add_machine(flecs::entity e, BenchEngine engine)
+{
+  if (engine == BE_STATIC)
+    e.set(StaticStateMachine<MachineType>{});
+  else
+    add_tag_state_machine<MachineType>(e);
+}
+
+// Agents stand far from their patrol point so patrols do a deterministic recovery
+// walk and both engines can be checked against each other by their actions.
+static std::vector<flecs::entity> spawn_agents(flecs::world &ecs, size_t count, BenchEngine engine)
+{
+  const std::shared_ptr<const StateMachineDef> defs[] = {
+    create_berserk_sm_def(), create_healer_sm_def(), create_patrol_attack_flee_sm_def(), create_patrol_flee_sm_def()};
+  std::vector<flecs::entity> agents;
+  agents.reserve(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    const int x = int(i % 1000) * 3;
+    const int y = int(i / 1000) * 3;
+    flecs::entity e = ecs.entity()
+      .set(Position{x, y})
+      .set(PatrolPos{x + 10, y})
+      .set(Hitpoints{100.f})
+      .set(Action{EA_NOP})
+      .set(AiSensors{})
+      .add<BenchAgent>();
+    if (engine == BE_VIRTUAL)
+      e.set(StateMachine{defs[i % 4]});
+    else if (i % 4 == 0)
+      add_machine<fsm::BerserkMachine>(e, engine);
+    else if (i % 4 == 1)
+      add_machine<fsm::HealerMachine>(e, engine);
+    else if (i % 4 == 2)
+      add_machine<fsm::PatrolAttackFleeMachine>(e, engine);
+    else
+      add_machine<fsm::PatrolFleeMachine>(e, engine);
+    agents.push_back(e);
+  }
+  return agents;
+}
+
+// sensors and hitpoints are faked the same way for both engines every turn
+static void feed_agents(const std::vector<flecs::entity> &agents, uint32_t turn)
+{
+  for (size_t i = 0; i < agents.size(); ++i)
+  {
+    const uint32_t h = hash(uint32_t(i) * 131u + turn);
+    const Position pos = *agents[i].get<Position>();
+    AiSensors &sensors = *agents[i].get_mut<AiSensors>();
+    sensors.enemyDist = (h & 15) == 15 ? FLT_MAX : float(h % 10);
+    sensors.enemyPos = Position{pos.x + int(h % 7) - 3, pos.y + int((h >> 8) % 7) - 3};
+    agents[i].get_mut<Hitpoints>()->hitpoints = float((h >> 16) % 120);
+    agents[i].get_mut<Action>()->action = EA_NOP;
+  }
+}
+
+static uint64_t checksum(const std::vector<flecs::entity> &agents)
+{
+  uint64_t sum = 0;
+  for (size_t i = 0; i < agents.size(); ++i)
+    sum = sum * 31 + uint64_t(agents[i].get<Action>()->action) + uint64_t(agents[i].get<Hitpoints>()->hitpoints);
+  return sum;
+}
+
+int main(int argc, const char **argv)
+{
+  const size_t numAgents = argc > 1 ? size_t(std::atoi(argv[1])) : 100000;
+  const uint32_t numTurns = argc > 2 ? uint32_t(std::atoi(argv[2])) : 20;
+
+  flecs::world ecs;
+  static auto stateMachineAct = ecs.query<StateMachine>();
+  const std::vector<flecs::entity> virtualAgents = spawn_agents(ecs, numAgents, BE_VIRTUAL);
+  const std::vector<flecs::entity> staticAgents = spawn_agents(ecs, numAgents, BE_STATIC);
+  const std::vector<flecs::entity> tagAgents = spawn_agents(ecs, numAgents, BE_TAGS);
+
+  double virtualMs = 0.0;
+  double staticMs = 0.0;
+  double tagsMs = 0.0;
+  size_t mismatchedTurns = 0;
+  for (uint32_t turn = 0; turn < numTurns; ++turn)
+  {
+    feed_agents(virtualAgents, turn);
+    feed_agents(staticAgents, turn);
+    feed_agents(tagAgents, turn);
+
+    auto start = std::chrono::steady_clock::now();
+    ecs.defer([&]
+    {
+      stateMachineAct.each([&](flecs::entity e, StateMachine &sm)
+      {
+        sm.act(0.f, ecs, e);
+      });
+    });
+    auto mid = std::chrono::steady_clock::now();
+    ecs.defer([&]
+    {
+      update_static_state_machines(ecs);
+    });
+    auto staticEnd = std::chrono::steady_clock::now();
+    update_tag_state_machines(ecs);
+    auto end = std::chrono::steady_clock::now();
+
+    virtualMs += std::chrono::duration<double, std::milli>(mid - start).count();
+    staticMs += std::chrono::duration<double, std::milli>(staticEnd - mid).count();
+    tagsMs += std::chrono::duration<double, std::milli>(end - staticEnd).count();
+    const uint64_t virtualSum = checksum(virtualAgents);
+    mismatchedTurns += virtualSum != checksum(staticAgents) || virtualSum != checksum(tagAgents);
+  }
+  printf("%zu agents, %u turns, values are per turn averages\n", numAgents, numTurns);
+  printf("%10s %12s\n", "engine", "time(ms)");
+  printf("%10s %12.3f\n", "virtual", virtualMs / double(numTurns));
+  printf("%10s %12.3f\n", "static", staticMs / double(numTurns));
+  printf("%10s %12.3f\n", "tags", tagsMs / double(numTurns));
+  printf("turns where engines disagree: %zu\n", mismatchedTurns);
+  return mismatchedTurns == 0 ? 0 : 1;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <cfloat>
 
 struct Position;
 struct MovePos;
@@ -94,6 +95,15 @@ struct Cooldown
   int time = 0;
 };
 
+// Filled once per turn by update_ai_sensors, states and transitions read it
+// instead of scanning the world on every check.
+struct AiSensors
+{
+  float enemyDist = FLT_MAX; // to the nearest enemy
+  Position enemyPos;
+  bool cooldownReady = false;
+};
+
 struct Craft
 {
   int resources = 0;
@@ -3,126 +3,115 @@
 #include "raylib.h"
 #include "stateMachine.h"
 #include "aiLibrary.h"
+#include "staticAiLibrary.h"
 
-static void add_crafter_sm(flecs::entity entity)
+// State machines are built once per archetype and shared, entities only keep
+// their current states.
+static std::shared_ptr<const StateMachineDef> create_crafter_sm_def()
 {
-  entity.get([](StateMachine &sm)
-  {
-    /// Craft state
-    auto craft_sm = new StateMachine{};
-    int go_to_chest = craft_sm->addState(create_move_to_tagged_state<Chest>());
-    int go_to_craft = craft_sm->addState(create_move_to_tagged_state<CraftingTable>());
-    int craft = craft_sm->addState(create_craft_state());
-    int loot = craft_sm->addState(create_loot_resources_state());
-    craft_sm->addTransition(create_near_target_transition<Chest>(1.f), go_to_chest, loot);
-    craft_sm->addTransition(create_near_target_transition<CraftingTable>(1.f), go_to_craft, craft);
-    craft_sm->addTransition(create_crafted_enough_transition(), craft, go_to_chest);
-    craft_sm->addTransition(create_looted_enough_transition(), loot, go_to_craft);
-
-    /// Sleep state
-    auto sleep_sm = new StateMachine{};
-    int go_to_bed = sleep_sm->addState(create_move_to_tagged_state<Bed>());
-    int sleep = sleep_sm->addState(create_sleep_state(10));
-    sleep_sm->addTransition(create_near_target_transition<Bed>(1.f), go_to_bed, sleep);
-
-    /// Protect state
-    auto protect_sm = new StateMachine{};
-    int move_to_enemy = protect_sm->addState(create_move_to_enemy_state());
-    int heal = protect_sm->addState(create_heal_state(20.f));
-    protect_sm->addTransition(create_hitpoints_less_than_transition(60.f), move_to_enemy, heal);
-    protect_sm->addTransition(create_negate_transition(create_hitpoints_less_than_transition(60.f)), heal, move_to_enemy);
-
-    int craft_sm_id = sm.addState(craft_sm);
-    int sleep_sm_id = sm.addState(sleep_sm);
-    int protect_sm_id = sm.addState(protect_sm);
-
-    sm.addTransition(create_and_transition(create_near_target_transition<Bed>(1.f), create_cooldown_transition()), sleep_sm_id, craft_sm_id);
-    sm.addTransition(create_filled_chest_transition(10), craft_sm_id, sleep_sm_id);
-    sm.addTransition(create_enemy_available_transition(5.f), craft_sm_id, protect_sm_id);
-    sm.addTransition(create_negate_transition(create_enemy_available_transition(4.f)), protect_sm_id, craft_sm_id);
-  });
+  auto sm = std::make_shared<StateMachineDef>();
+
+  /// Craft state
+  int craft_sm = sm->addMachine();
+  int go_to_chest = sm->addState(create_move_to_tagged_state<Chest>(), craft_sm);
+  int go_to_craft = sm->addState(create_move_to_tagged_state<CraftingTable>(), craft_sm);
+  int craft = sm->addState(create_craft_state(), craft_sm);
+  int loot = sm->addState(create_loot_resources_state(), craft_sm);
+  sm->addTransition(create_near_target_transition<Chest>(1.f), go_to_chest, loot, craft_sm);
+  sm->addTransition(create_near_target_transition<CraftingTable>(1.f), go_to_craft, craft, craft_sm);
+  sm->addTransition(create_crafted_enough_transition(), craft, go_to_chest, craft_sm);
+  sm->addTransition(create_looted_enough_transition(), loot, go_to_craft, craft_sm);
+
+  /// Sleep state
+  int sleep_sm = sm->addMachine();
+  int go_to_bed = sm->addState(create_move_to_tagged_state<Bed>(), sleep_sm);
+  int sleep = sm->addState(create_sleep_state(10), sleep_sm);
+  sm->addTransition(create_near_target_transition<Bed>(1.f), go_to_bed, sleep, sleep_sm);
+
+  /// Protect state
+  int protect_sm = sm->addMachine();
+  int move_to_enemy = sm->addState(create_move_to_enemy_state(), protect_sm);
+  int heal = sm->addState(create_heal_state(20.f), protect_sm);
+  sm->addTransition(create_hitpoints_less_than_transition(60.f), move_to_enemy, heal, protect_sm);
+  sm->addTransition(create_negate_transition(create_hitpoints_less_than_transition(60.f)), heal, move_to_enemy, protect_sm);
+
+  int craft_sm_id = sm->addMachineState(craft_sm);
+  int sleep_sm_id = sm->addMachineState(sleep_sm);
+  int protect_sm_id = sm->addMachineState(protect_sm);
+
+  sm->addTransition(create_and_transition(create_near_target_transition<Bed>(1.f), create_cooldown_transition()), sleep_sm_id, craft_sm_id);
+  sm->addTransition(create_filled_chest_transition(10), craft_sm_id, sleep_sm_id);
+  sm->addTransition(create_enemy_available_transition(5.f), craft_sm_id, protect_sm_id);
+  sm->addTransition(create_negate_transition(create_enemy_available_transition(4.f)), protect_sm_id, craft_sm_id);
+  sm->compile();
+  return sm;
 }
 
-static void add_berserk_sm(flecs::entity entity)
+static std::shared_ptr<const StateMachineDef> create_guardian_sm_def()
 {
-  entity.get([](StateMachine &sm)
-  {
-    int patrol = sm.addState(create_patrol_state(4.f));
-    int moveToEnemy = sm.addState(create_move_to_enemy_state());
+  auto sm = std::make_shared<StateMachineDef>();
+  int patrol_player = sm->addState(create_patrol_tagged_state<IsPlayer>(5.f));
+  int heal_player = sm->addState(create_heal_player_state(5.0f, 20.0f, 10));
+  int attack_enemy = sm->addState(create_move_to_tagged_state<IsMonster>());
+
+  sm->addTransition(create_and_transition(create_player_hp_less_transition(100.f), create_cooldown_transition()), patrol_player, heal_player);
+  sm->addTransition(create_negate_transition(create_cooldown_transition()), heal_player, patrol_player);
+  sm->addTransition(create_enemy_available_transition(4.f), patrol_player, attack_enemy);
+  sm->addTransition(create_negate_transition(create_enemy_available_transition(5.f)), attack_enemy, patrol_player);
+  sm->compile();
+  return sm;
+}
 
-    sm.addTransition(create_enemy_available_transition(7.f), patrol, moveToEnemy);
-    sm.addTransition(create_hitpoints_less_than_transition(60.f), patrol, moveToEnemy);
+static std::shared_ptr<const StateMachineDef> create_attack_sm_def()
+{
+  auto sm = std::make_shared<StateMachineDef>();
+  sm->addState(create_move_to_enemy_state());
+  sm->compile();
+  return sm;
+}
 
-    sm.addTransition(create_and_transition(create_negate_transition(create_enemy_available_transition(7.f)), 
-                     create_negate_transition(create_hitpoints_less_than_transition(60.f))), moveToEnemy, patrol);
-  });
+static void add_crafter_sm(flecs::entity entity)
+{
+  static const std::shared_ptr<const StateMachineDef> crafterSm = create_crafter_sm_def();
+  entity.set(StateMachine{crafterSm});
 }
 
-static void add_healer_sm(flecs::entity entity)
+// berserks run on the compile time machine ticked per entity
+static void add_berserk_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
-  {
-    int patrol = sm.addState(create_patrol_state(4.f));
-    int heal = sm.addState(create_heal_state(10.f));
+  entity.remove<StateMachine>();
+  entity.set(StaticStateMachine<fsm::BerserkMachine>{});
+}
 
-    sm.addTransition(create_hitpoints_less_than_transition(90.f), patrol, heal);
-    sm.addTransition(create_negate_transition(create_hitpoints_less_than_transition(90.f)), heal, patrol);
-  });
+// healers run on the compile time machine ticked per state from tags
+static void add_healer_sm(flecs::entity entity)
+{
+  entity.remove<StateMachine>();
+  add_tag_state_machine<fsm::HealerMachine>(entity);
 }
 
 static void add_guardian_sm(flecs::entity entity)
 {
-  entity.get([&](StateMachine &sm)
-  {
-    int patrol_player = sm.addState(create_patrol_tagged_state<IsPlayer>(5.f));
-    int heal_player = sm.addState(create_heal_player_state(5.0f, 20.0f, 10));
-    int attack_enemy = sm.addState(create_move_to_tagged_state<IsMonster>());
-
-    sm.addTransition(create_and_transition(create_player_hp_less_transition(100.f), create_cooldown_transition()), patrol_player, heal_player);
-    sm.addTransition(create_negate_transition(create_cooldown_transition()), heal_player, patrol_player);
-    sm.addTransition(create_enemy_available_transition(4.f), patrol_player, attack_enemy);
-    sm.addTransition(create_negate_transition(create_enemy_available_transition(5.f)), attack_enemy, patrol_player);
-  });
+  static const std::shared_ptr<const StateMachineDef> guardianSm = create_guardian_sm_def();
+  entity.set(StateMachine{guardianSm});
 }
 
 static void add_patrol_attack_flee_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
-  {
-    int patrol = sm.addState(create_patrol_state(3.f));
-    int moveToEnemy = sm.addState(create_move_to_enemy_state());
-    int fleeFromEnemy = sm.addState(create_flee_from_enemy_state());
-
-    sm.addTransition(create_enemy_available_transition(3.f), patrol, moveToEnemy);
-    sm.addTransition(create_negate_transition(create_enemy_available_transition(5.f)), moveToEnemy, patrol);
-
-    sm.addTransition(create_and_transition(create_hitpoints_less_than_transition(60.f), create_enemy_available_transition(5.f)),
-                     moveToEnemy, fleeFromEnemy);
-    sm.addTransition(create_and_transition(create_hitpoints_less_than_transition(60.f), create_enemy_available_transition(3.f)),
-                     patrol, fleeFromEnemy);
-
-    sm.addTransition(create_negate_transition(create_enemy_available_transition(7.f)), fleeFromEnemy, patrol);
-  });
+  static const std::shared_ptr<const StateMachineDef> patrolAttackFleeSm = create_patrol_attack_flee_sm_def();
+  entity.set(StateMachine{patrolAttackFleeSm});
 }
 
 static void add_patrol_flee_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
-  {
-    int patrol = sm.addState(create_patrol_state(3.f));
-    int fleeFromEnemy = sm.addState(create_flee_from_enemy_state());
-
-    sm.addTransition(create_enemy_available_transition(3.f), patrol, fleeFromEnemy);
-    sm.addTransition(create_negate_transition(create_enemy_available_transition(5.f)), fleeFromEnemy, patrol);
-  });
+  static const std::shared_ptr<const StateMachineDef> patrolFleeSm = create_patrol_flee_sm_def();
+  entity.set(StateMachine{patrolFleeSm});
 }
 
 static void add_attack_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
-  {
-    sm.addState(create_move_to_enemy_state());
-  });
+  static const std::shared_ptr<const StateMachineDef> attackSm = create_attack_sm_def();
+  entity.set(StateMachine{attackSm});
 }
 
 static flecs::entity create_monster(flecs::world &ecs, int x, int y, Color color)
@@ -136,6 +125,7 @@ static flecs::entity create_monster(flecs::world &ecs, int x, int y, Color color
     .add<IsMonster>()
     .set(Color{color})
     .set(StateMachine{})
+    .set(AiSensors{})
     .set(Team{1})
     .set(NumActions{1, 0})
     .set(MeleeDamage{20.f});
@@ -151,6 +141,7 @@ static flecs::entity create_npc(flecs::world &ecs, int x, int y, Color color)
     .add<IsFriend>()
     .set(Color{color})
     .set(StateMachine{})
+    .set(AiSensors{})
     .set(Team{0})
     .set(NumActions{1, 0})
     .set(MeleeDamage{20.f})
@@ -167,6 +158,7 @@ static flecs::entity create_crafter(flecs::world &ecs, int x, int y, Color color
     .add<IsFriend>()
     .set(Color{color})
     .set(StateMachine{})
+    .set(AiSensors{})
     .set(Team{0})
     .set(NumActions{1, 0})
     .set(MeleeDamage{20.f})
@@ -422,12 +414,15 @@ void process_turn(flecs::world &ecs)
     if (upd_player_actions_count(ecs))
     {
       // Plan action for NPCs
+      update_ai_sensors(ecs);
+      update_tag_state_machines(ecs);
       ecs.defer([&]
       {
         stateMachineAct.each([&](flecs::entity e, StateMachine &sm)
         {
           sm.act(0.f, ecs, e);
         });
+        update_static_state_machines(ecs);
       });
     }
     process_actions(ecs);
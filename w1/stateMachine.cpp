@@ -1,45 +1,169 @@
 #include "stateMachine.h"
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
 
-StateMachine::~StateMachine()
+// StateMachine keeps the state of every machine in a fixed array, a def that
+// doesn't fit into it can't be used in any build.
+static void fail_machine_limit(const char *what, size_t value)
 {
-  for (State* state : states)
-    if (dynamic_cast<StateMachine*>(state) == nullptr)
-      delete state;
-  states.clear();
-  for (auto &transList : transitions)
-    for (auto &transition : transList)
-      delete transition.first;
-  transitions.clear();
+  std::fprintf(stderr, "StateMachineDef: %s %zu exceeds max_machines %d\n", what, value, StateMachineDef::max_machines);
+  std::abort();
 }
 
-void StateMachine::act(float dt, flecs::world &ecs, flecs::entity entity)
+StateMachineDef::StateMachineDef()
 {
-  if (curStateIdx < states.size())
+  machines.emplace_back();
+}
+
+StateMachineDef::~StateMachineDef()
+{
+  for (Machine &machine : machines)
   {
-    for (const std::pair<StateTransition*, int> &transition : transitions[curStateIdx])
-      if (transition.first->isAvailable(ecs, entity))
-      {
-        states[curStateIdx]->exit();
-        curStateIdx = transition.second;
-        states[curStateIdx]->enter();
-        break;
-      }
-    states[curStateIdx]->act(dt, ecs, entity);
+    for (MachineState &state : machine.states)
+      delete state.state;
+    for (auto &transList : machine.transitions)
+      for (auto &transition : transList)
+        delete transition.first;
   }
-  else
-    curStateIdx = 0;
+  machines.clear();
+}
+
+int StateMachineDef::addMachine()
+{
+  if (machines.size() >= size_t(max_machines))
+    fail_machine_limit("machine count", machines.size() + 1);
+  machines.emplace_back();
+  return int(machines.size()) - 1;
 }
 
-int StateMachine::addState(State *st)
+int StateMachineDef::addState(State *st, int machine)
 {
-  int idx = states.size();
-  states.push_back(st);
-  transitions.push_back(std::vector<std::pair<StateTransition*, int>>());
+  Machine &m = machines[size_t(machine)];
+  int idx = int(m.states.size());
+  m.states.push_back(MachineState{st, -1});
+  m.transitions.push_back(std::vector<std::pair<StateTransition*, int>>());
   return idx;
 }
 
-void StateMachine::addTransition(StateTransition *trans, int from, int to)
+int StateMachineDef::addMachineState(int nested_machine, int machine)
+{
+  Machine &m = machines[size_t(machine)];
+  int idx = int(m.states.size());
+  m.states.push_back(MachineState{nullptr, nested_machine});
+  m.transitions.push_back(std::vector<std::pair<StateTransition*, int>>());
+  return idx;
+}
+
+void StateMachineDef::addTransition(StateTransition *trans, int from, int to, int machine)
+{
+  machines[size_t(machine)].transitions[size_t(from)].push_back(std::make_pair(trans, to));
+}
+
+int StateMachineDef::compileNode(int machine, int level, std::vector<std::pair<int, int>> &path,
+                                 std::vector<std::vector<std::pair<int, int>>> &leaf_paths)
+{
+  if (level >= max_machines)
+    fail_machine_limit("nesting depth", size_t(level) + 1);
+  const int nodeIdx = int(nodes.size());
+  nodes.push_back(FlatNode{machine, -1, {}});
+  const Machine &m = machines[size_t(machine)];
+  if (m.states.empty())
+  {
+    nodes[size_t(nodeIdx)].emptyLeaf = int(leaves.size());
+    leaves.push_back(FlatLeaf{nullptr, level, {}});
+    leaf_paths.push_back(path);
+    return nodeIdx;
+  }
+  for (size_t i = 0; i < m.states.size(); ++i)
+  {
+    path.push_back(std::make_pair(nodeIdx, int(i)));
+    FlatTarget target;
+    if (m.states[i].state)
+    {
+      target.leaf = int(leaves.size());
+      leaves.push_back(FlatLeaf{m.states[i].state, level, {}});
+      leaf_paths.push_back(path);
+    }
+    else
+      target.node = compileNode(m.states[i].nestedMachine, level + 1, path, leaf_paths);
+    path.pop_back();
+    nodes[size_t(nodeIdx)].children.push_back(target);
+  }
+  return nodeIdx;
+}
+
+void StateMachineDef::compile()
+{
+  if (machines.size() > size_t(max_machines))
+    fail_machine_limit("machine count", machines.size());
+  nodes.clear();
+  leaves.clear();
+  std::vector<std::pair<int, int>> path;
+  std::vector<std::vector<std::pair<int, int>>> leafPaths;
+  compileNode(root_machine, 0, path, leafPaths);
+  // transitions can only be filled once all targets have their leaves
+  for (size_t leafIdx = 0; leafIdx < leaves.size(); ++leafIdx)
+    for (size_t level = 0; level < leafPaths[leafIdx].size(); ++level)
+    {
+      const FlatNode &node = nodes[size_t(leafPaths[leafIdx][level].first)];
+      const int from = leafPaths[leafIdx][level].second;
+      for (const std::pair<StateTransition*, int> &transition : machines[size_t(node.machine)].transitions[size_t(from)])
+        leaves[leafIdx].transitions.push_back(FlatTransition{transition.first, int(level), node.machine,
+                                                             transition.second, node.children[size_t(transition.second)]});
+    }
+}
+
+int StateMachineDef::resolveLeaf(int node, const int *cur_states) const
+{
+  for (;;)
+  {
+    const FlatNode &n = nodes[size_t(node)];
+    if (n.emptyLeaf >= 0)
+      return n.emptyLeaf;
+    const FlatTarget &target = n.children[size_t(cur_states[n.machine])];
+    if (target.leaf >= 0)
+      return target.leaf;
+    node = target.node;
+  }
+}
+
+int StateMachineDef::act(int leaf, int *cur_states, float dt, flecs::world &ecs, flecs::entity entity) const
 {
-  transitions[from].push_back(std::make_pair(trans, to));
+  assert(!leaves.empty() && "StateMachineDef::compile wasn't called");
+  if (leaf < 0)
+    leaf = resolveLeaf(0, cur_states);
+  int minLevel = 0;
+  bool transited = true;
+  while (transited)
+  {
+    transited = false;
+    for (const FlatTransition &transition : leaves[size_t(leaf)].transitions)
+      if (transition.level >= minLevel && transition.transition->isAvailable(ecs, entity))
+      {
+        const FlatLeaf &from = leaves[size_t(leaf)];
+        if (from.state && from.level == transition.level)
+          from.state->exit();
+        cur_states[transition.machine] = transition.to;
+        if (transition.target.leaf >= 0)
+        {
+          leaf = transition.target.leaf;
+          leaves[size_t(leaf)].state->enter();
+        }
+        else
+          leaf = resolveLeaf(transition.target.node, cur_states);
+        minLevel = transition.level + 1;
+        transited = true;
+        break;
+      }
+  }
+  if (leaves[size_t(leaf)].state)
+    leaves[size_t(leaf)].state->act(dt, ecs, entity);
+  return leaf;
 }
 
+void StateMachine::act(float dt, flecs::world &ecs, flecs::entity entity)
+{
+  if (def)
+    curLeaf = def->act(curLeaf, curStates, dt, ecs, entity);
+}
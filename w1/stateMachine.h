@@ -1,4 +1,5 @@
 #pragma once
+#include <memory>
 #include <vector>
 #include <flecs.h>
 
@@ -8,7 +9,7 @@ public:
   virtual ~State() {};
   virtual void enter() const = 0;
   virtual void exit() const = 0;
-  virtual void act(float dt, flecs::world &ecs, flecs::entity entity) = 0;
+  virtual void act(float dt, flecs::world &ecs, flecs::entity entity) const = 0;
 };
 
 class StateTransition
@@ -18,26 +19,97 @@ public:
   virtual bool isAvailable(flecs::world &ecs, flecs::entity entity) const = 0;
 };
 
-class StateMachine : public State
+// Immutable state machine shared by all entities of an archetype. It holds the
+// root machine and all machines nested into it, entities only keep the current
+// state of each of them in StateMachine.
+class StateMachineDef
 {
-  int curStateIdx = 0;
-  std::vector<State*> states;
-  std::vector<std::vector<std::pair<StateTransition*, int>>> transitions;
 public:
-  StateMachine() = default;
-  StateMachine(const StateMachine &sm) = default;
-  StateMachine(StateMachine &&sm) = default;
+  static constexpr int root_machine = 0;
+  static constexpr int max_machines = 8; // per entity state is a fixed array, exceeding it aborts
+
+  StateMachineDef();
+  StateMachineDef(const StateMachineDef &def) = delete;
+  StateMachineDef &operator=(const StateMachineDef &def) = delete;
+
+  ~StateMachineDef();
+
+  int addMachine(); // nested machine, add it to its parent with addMachineState
+  int addState(State *st, int machine = root_machine);
+  int addMachineState(int nested_machine, int machine = root_machine);
+  void addTransition(StateTransition *trans, int from, int to, int machine = root_machine);
+
+  // Flattens the machine with all machines nested into it into one table of
+  // leaf states, has to be called once the machine is built.
+  void compile();
+
+  // Ticks the machine from the given leaf (-1 if unknown yet) and returns the
+  // new one. cur_states keep the state of every machine so nested machines
+  // resume where they were left.
+  int act(int leaf, int *cur_states, float dt, flecs::world &ecs, flecs::entity entity) const;
+
+private:
+  struct MachineState
+  {
+    State *state = nullptr; // owned
+    int nestedMachine = -1;
+  };
+
+  struct Machine
+  {
+    std::vector<MachineState> states;
+    std::vector<std::vector<std::pair<StateTransition*, int>>> transitions; // transitions are owned
+  };
 
-  ~StateMachine();
+  // Flat form: every path from the root to a leaf state is a leaf with the
+  // transitions of all machines along the path, outer ones first. Taking a
+  // transition on some level only lets deeper levels transit in the same tick.
+  struct FlatTarget
+  {
+    int leaf = -1; // target is a leaf state
+    int node = -1; // target is a nested machine, its leaf comes from cur_states
+  };
 
-  StateMachine &operator=(const StateMachine &sm) = default;
-  StateMachine &operator=(StateMachine &&sm) = default;
+  struct FlatTransition
+  {
+    const StateTransition *transition = nullptr;
+    int level = 0;
+    int machine = 0;
+    int to = 0;
+    FlatTarget target;
+  };
 
-  virtual void enter() const {}
-  virtual void exit() const {}
-  virtual void act(float dt, flecs::world &ecs, flecs::entity entity);
+  struct FlatLeaf
+  {
+    const State *state = nullptr; // nullptr for an empty machine
+    int level = 0;
+    std::vector<FlatTransition> transitions;
+  };
 
-  int addState(State *st);
-  void addTransition(StateTransition *trans, int from, int to);
+  struct FlatNode
+  {
+    int machine = 0;
+    int emptyLeaf = -1;
+    std::vector<FlatTarget> children; // per state of the machine
+  };
+
+  int compileNode(int machine, int level, std::vector<std::pair<int, int>> &path,
+                  std::vector<std::vector<std::pair<int, int>>> &leaf_paths);
+  int resolveLeaf(int node, const int *cur_states) const;
+
+  std::vector<Machine> machines;
+  std::vector<FlatNode> nodes;
+  std::vector<FlatLeaf> leaves;
 };
 
+class StateMachine
+{
+  std::shared_ptr<const StateMachineDef> def;
+  int curStates[StateMachineDef::max_machines] = {};
+  int curLeaf = -1;
+public:
+  StateMachine() = default;
+  explicit StateMachine(std::shared_ptr<const StateMachineDef> in_def) : def(std::move(in_def)) {}
+
+  void act(float dt, flecs::world &ecs, flecs::entity entity);
+};
@@ -0,0 +1,17 @@
+#include "staticAiLibrary.h"
+
+void update_static_state_machines(flecs::world &ecs)
+{
+  act_static_state_machines<fsm::BerserkMachine>(ecs);
+  act_static_state_machines<fsm::HealerMachine>(ecs);
+  act_static_state_machines<fsm::PatrolAttackFleeMachine>(ecs);
+  act_static_state_machines<fsm::PatrolFleeMachine>(ecs);
+}
+
+void update_tag_state_machines(flecs::world &ecs)
+{
+  act_tag_state_machines<fsm::BerserkMachine>(ecs);
+  act_tag_state_machines<fsm::HealerMachine>(ecs);
+  act_tag_state_machines<fsm::PatrolAttackFleeMachine>(ecs);
+  act_tag_state_machines<fsm::PatrolFleeMachine>(ecs);
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include <cfloat>
+#include <flecs.h>
+#include "raylib.h"
+#include "aiUtils.h"
+#include "ecsTypes.h"
+#include "staticStateMachine.h"
+
+// What static machine states and predicates see of an agent
+struct AiAgent
+{
+  const AiSensors &sensors;
+  const Position &pos;
+  const PatrolPos &patrolPos;
+  Hitpoints &hitpoints;
+  Action &action;
+};
+
+// Same logic as the matching states and transitions in aiLibrary.cpp.
+namespace fsm
+{
+  // predicates
+  template<int Dist>
+  struct EnemyAvailable
+  {
+    static bool check(const AiAgent &agent) { return agent.sensors.enemyDist <= float(Dist); }
+  };
+
+  template<int Threshold>
+  struct HitpointsLessThan
+  {
+    static bool check(const AiAgent &agent) { return agent.hitpoints.hitpoints < float(Threshold); }
+  };
+
+  // states
+  template<int Dist>
+  struct Patrol
+  {
+    static void act(AiAgent &agent)
+    {
+      if (dist(agent.pos, agent.patrolPos) > float(Dist))
+        agent.action.action = move_towards(agent.pos, agent.patrolPos); // do a recovery walk
+      else
+        agent.action.action = GetRandomValue(EA_MOVE_START, EA_MOVE_END - 1); // do a random walk
+    }
+  };
+
+  struct MoveToEnemy
+  {
+    static void act(AiAgent &agent)
+    {
+      if (agent.sensors.enemyDist < FLT_MAX)
+        agent.action.action = move_towards(agent.pos, agent.sensors.enemyPos);
+    }
+  };
+
+  struct FleeFromEnemy
+  {
+    static void act(AiAgent &agent)
+    {
+      if (agent.sensors.enemyDist < FLT_MAX)
+        agent.action.action = inverse_move(move_towards(agent.pos, agent.sensors.enemyPos));
+    }
+  };
+
+  template<int Amount>
+  struct Heal
+  {
+    static void act(AiAgent &agent) { agent.hitpoints.hitpoints += float(Amount); }
+  };
+
+  // archetypes
+  using BerserkMachine = Machine<
+    States<Patrol<4>, MoveToEnemy>,
+    Transitions<
+      Transition<Patrol<4>, MoveToEnemy, EnemyAvailable<7>>,
+      Transition<Patrol<4>, MoveToEnemy, HitpointsLessThan<60>>,
+      Transition<MoveToEnemy, Patrol<4>, And<Not<EnemyAvailable<7>>, Not<HitpointsLessThan<60>>>>>>;
+
+  using HealerMachine = Machine<
+    States<Patrol<4>, Heal<10>>,
+    Transitions<
+      Transition<Patrol<4>, Heal<10>, HitpointsLessThan<90>>,
+      Transition<Heal<10>, Patrol<4>, Not<HitpointsLessThan<90>>>>>;
+
+  using PatrolAttackFleeMachine = Machine<
+    States<Patrol<3>, MoveToEnemy, FleeFromEnemy>,
+    Transitions<
+      Transition<Patrol<3>, MoveToEnemy, EnemyAvailable<3>>,
+      Transition<MoveToEnemy, Patrol<3>, Not<EnemyAvailable<5>>>,
+      Transition<MoveToEnemy, FleeFromEnemy, And<HitpointsLessThan<60>, EnemyAvailable<5>>>,
+      Transition<Patrol<3>, FleeFromEnemy, And<HitpointsLessThan<60>, EnemyAvailable<3>>>,
+      Transition<FleeFromEnemy, Patrol<3>, Not<EnemyAvailable<7>>>>>;
+
+  using PatrolFleeMachine = Machine<
+    States<Patrol<3>, FleeFromEnemy>,
+    Transitions<
+      Transition<Patrol<3>, FleeFromEnemy, EnemyAvailable<3>>,
+      Transition<FleeFromEnemy, Patrol<3>, Not<EnemyAvailable<5>>>>>;
+}
+
+template<typename MachineType>
+inline void act_static_state_machines(flecs::world &ecs)
+{
+  static auto machinesQuery =
+    ecs.query<StaticStateMachine<MachineType>, const AiSensors, const Position, const PatrolPos, Hitpoints, Action>();
+  machinesQuery.each([](StaticStateMachine<MachineType> &sm, const AiSensors &sensors, const Position &pos,
+                        const PatrolPos &ppos, Hitpoints &hp, Action &a)
+  {
+    AiAgent agent{sensors, pos, ppos, hp, a};
+    MachineType::act(sm.state, agent);
+  });
+}
+
+// ticks every entity with a StaticStateMachine of one of the archetypes above
+void update_static_state_machines(flecs::world &ecs);
+
+// Tag driven mode of the same machines: an agent is in state S while it has
+// the (CurrentState, S) pair, so every state is ticked as one batch over the
+// tables of the agents that are in it.
+struct CurrentState {};
+
+template<typename MachineType>
+struct TagStateMachine {};
+
+template<typename MachineType>
+inline void add_tag_state_machine(flecs::entity entity)
+{
+  entity.add<TagStateMachine<MachineType>>();
+  entity.add<CurrentState, typename MachineType::InitialState>();
+}
+
+template<typename MachineType, typename StateType>
+inline void transit_tag_state(flecs::world &ecs)
+{
+  static auto stateQuery = ecs.query_builder<const AiSensors, const Position, const PatrolPos, Hitpoints, Action>()
+    .template term<TagStateMachine<MachineType>>()
+    .template term<CurrentState, StateType>()
+    .build();
+  stateQuery.each([](flecs::entity e, const AiSensors &sensors, const Position &pos, const PatrolPos &ppos,
+                     Hitpoints &hp, Action &a)
+  {
+    AiAgent agent{sensors, pos, ppos, hp, a};
+    MachineType::template transit<StateType>(agent, [&](auto to)
+    {
+      e.remove<CurrentState, StateType>();
+      e.add<CurrentState, decltype(to)>();
+    });
+  });
+}
+
+template<typename MachineType, typename StateType>
+inline void act_tag_state(flecs::world &ecs)
+{
+  static auto stateQuery = ecs.query_builder<const AiSensors, const Position, const PatrolPos, Hitpoints, Action>()
+    .template term<TagStateMachine<MachineType>>()
+    .template term<CurrentState, StateType>()
+    .build();
+  stateQuery.each([](const AiSensors &sensors, const Position &pos, const PatrolPos &ppos, Hitpoints &hp, Action &a)
+  {
+    AiAgent agent{sensors, pos, ppos, hp, a};
+    StateType::act(agent);
+  });
+}
+
+// Transitions of all states are deferred so they see the states of the
+// previous turn, then every state acts on the agents that are in it now.
+template<typename MachineType>
+inline void act_tag_state_machines(flecs::world &ecs)
+{
+  ecs.defer([&]
+  {
+    MachineType::forEachState([&](auto state) { transit_tag_state<MachineType, decltype(state)>(ecs); });
+  });
+  MachineType::forEachState([&](auto state) { act_tag_state<MachineType, decltype(state)>(ecs); });
+}
+
+// ticks every entity with a TagStateMachine of one of the archetypes above,
+// must not be called inside a deferred block
+void update_tag_state_machines(flecs::world &ecs);
@@ -0,0 +1,95 @@
+#pragma once
+#include <type_traits>
+#include <variant>
+
+// State machine with states and transitions fixed at compile time. States and
+// predicates are types with static functions, so a tick has no virtual calls
+// or wrapper objects and the compiler can inline the whole decision.
+namespace fsm
+{
+  template<typename Predicate>
+  struct Not
+  {
+    template<typename Context>
+    static bool check(const Context &ctx) { return !Predicate::check(ctx); }
+  };
+
+  template<typename... Predicates>
+  struct And
+  {
+    template<typename Context>
+    static bool check(const Context &ctx) { return (Predicates::check(ctx) && ...); }
+  };
+
+  template<typename FromState, typename ToState, typename Predicate>
+  struct Transition
+  {
+    using From = FromState;
+    using To = ToState;
+    using When = Predicate;
+  };
+
+  template<typename... Ts> struct States {};
+  template<typename... Ts> struct Transitions {};
+
+  template<typename StateList, typename TransitionList>
+  struct Machine;
+
+  // The first state is the initial one. Transitions from the current state
+  // are tried in the order they are listed, the first available one is taken.
+  template<typename... S, typename... T>
+  struct Machine<States<S...>, Transitions<T...>>
+  {
+    using State = std::variant<S...>;
+    using InitialState = std::variant_alternative_t<0, State>;
+
+    template<typename Context>
+    static void act(State &state, Context &ctx)
+    {
+      std::visit([&](auto cur)
+      {
+        transit<decltype(cur)>(ctx, [&](auto to) { state.template emplace<decltype(to)>(); });
+      }, state);
+      std::visit([&](auto cur)
+      {
+        decltype(cur)::act(ctx);
+      }, state);
+    }
+
+    // Calls on_transition with the target state of the first available
+    // transition from Cur, returns false if there is none.
+    template<typename Cur, typename Context, typename Callback>
+    static bool transit(const Context &ctx, Callback &&on_transition)
+    {
+      return (tryTransition<Cur, T>(ctx, on_transition) || ...);
+    }
+
+    template<typename Callback>
+    static void forEachState(Callback &&callback)
+    {
+      (callback(S{}), ...);
+    }
+
+  private:
+    template<typename Cur, typename Trans, typename Context, typename Callback>
+    static bool tryTransition(const Context &ctx, Callback &on_transition)
+    {
+      if constexpr (std::is_same_v<Cur, typename Trans::From>)
+      {
+        if (Trans::When::check(ctx))
+        {
+          on_transition(typename Trans::To{});
+          return true;
+        }
+      }
+      return false;
+    }
+  };
+}
+
+// ECS component, one type per machine so each machine is ticked over its own tables
+template<typename MachineType>
+struct StaticStateMachine
+{
+  typename MachineType::State state;
+};
@@ -4,6 +4,7 @@
 #include "math.h"
 #include "raylib.h"
 #include "blackboard.h"
+#include "pickupIndex.h"
 
 struct CompoundNode : public BehNode
 {
@@ -240,29 +241,47 @@ struct FindClosestByTag : public BehNode
   BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
     BehResult res = BEH_FAIL;
-    static auto query = ecs.query<const Position, const Tag>();
-    entity.set([&](const Position &pos)
+    if constexpr (std::is_same_v<Tag, Pickup>)
     {
-      flecs::entity closestTagged;
-      float closestDist = FLT_MAX;
-      Position closestPos;
-      query.each([&](flecs::entity enemy, const Position &epos, const Tag &tag)
+      entity.set([&](const Position &pos)
       {
-        if (enemy == entity) return;
-        float curDist = dist(epos, pos);
-        if (curDist < closestDist)
+        query_pickup_index(ecs, [&](const PickupIndex &pickups)
         {
-          closestDist = curDist;
-          closestPos = epos;
-          closestTagged = enemy;
-        }
+          flecs::entity closestPickup = find_closest_pickup(pickups, pos, entity);
+          if (ecs.is_valid(closestPickup))
+          {
+            bb.set<flecs::entity>(entityBb, closestPickup);
+            res = BEH_SUCCESS;
+          }
+        });
       });
-      if (ecs.is_valid(closestTagged))
+    }
+    else
+    {
+      static auto query = ecs.query<const Position, const Tag>();
+      entity.set([&](const Position &pos)
       {
-        bb.set<flecs::entity>(entityBb, closestTagged);
-        res = BEH_SUCCESS;
-      }
-    });
+        flecs::entity closestTagged;
+        float closestDist = FLT_MAX;
+        Position closestPos;
+        query.each([&](flecs::entity enemy, const Position &epos, const Tag &tag)
+        {
+          if (enemy == entity) return;
+          float curDist = dist(epos, pos);
+          if (curDist < closestDist)
+          {
+            closestDist = curDist;
+            closestPos = epos;
+            closestTagged = enemy;
+          }
+        });
+        if (ecs.is_valid(closestTagged))
+        {
+          bb.set<flecs::entity>(entityBb, closestTagged);
+          res = BEH_SUCCESS;
+        }
+      });
+    }
     return res;
   }
 };
@@ -0,0 +1,127 @@
+#include "pickupIndex.h"
+#include <algorithm>
+#include <cfloat>
+#include "math.h"
+
+int pickup_cell_coord(int v)
+{
+  // floor division, the level spreads to negative coordinates
+  return v >= 0 ? v / PickupIndex::cellSize : -((-v + PickupIndex::cellSize - 1) / PickupIndex::cellSize);
+}
+
+uint64_t pickup_cell_key(int cell_x, int cell_y)
+{
+  return (uint64_t(uint32_t(cell_x)) << 32) | uint64_t(uint32_t(cell_y));
+}
+
+static void remove_pickup(PickupIndex &index, flecs::entity pickup)
+{
+  const auto itf = index.positions.find(pickup.id());
+  if (itf == index.positions.end())
+    return;
+  const uint64_t key = pickup_cell_key(pickup_cell_coord(itf->second.x), pickup_cell_coord(itf->second.y));
+  std::vector<flecs::entity> &cell = index.cells[key];
+  cell.erase(std::find(cell.begin(), cell.end(), pickup));
+  if (cell.empty())
+    index.cells.erase(key);
+  index.positions.erase(itf);
+}
+
+static void add_pickup(PickupIndex &index, flecs::entity pickup, const Position &pos)
+{
+  const auto itf = index.positions.find(pickup.id());
+  if (itf != index.positions.end() && itf->second == pos)
+    return;
+  remove_pickup(index, pickup);
+  const int cx = pickup_cell_coord(pos.x);
+  const int cy = pickup_cell_coord(pos.y);
+  if (index.maxCellX < index.minCellX)
+  {
+    index.minCellX = index.maxCellX = cx;
+    index.minCellY = index.maxCellY = cy;
+  }
+  index.minCellX = std::min(index.minCellX, cx);
+  index.minCellY = std::min(index.minCellY, cy);
+  index.maxCellX = std::max(index.maxCellX, cx);
+  index.maxCellY = std::max(index.maxCellY, cy);
+  index.cells[pickup_cell_key(cx, cy)].push_back(pickup);
+  index.positions.emplace(pickup.id(), pos);
+}
+
+void register_pickup_index(flecs::world &ecs)
+{
+  static auto pickupIndexQuery = ecs.query<PickupIndex>();
+  ecs.entity("pickup_index")
+    .set(PickupIndex{});
+  // the tag is added after the position, the position may also be set later
+  ecs.observer<const Position, const Pickup>()
+    .event(flecs::OnAdd)
+    .event(flecs::OnSet)
+    .each([](flecs::entity pickup, const Position &pos, const Pickup &)
+    {
+      pickupIndexQuery.each([&](PickupIndex &index)
+      {
+        add_pickup(index, pickup, pos);
+      });
+    });
+  ecs.observer<const Position, const Pickup>()
+    .event(flecs::OnRemove)
+    .each([](flecs::entity pickup, const Position &, const Pickup &)
+    {
+      pickupIndexQuery.each([&](PickupIndex &index)
+      {
+        remove_pickup(index, pickup);
+      });
+    });
+}
+
+flecs::entity find_closest_pickup(const PickupIndex &index, const Position &pos, flecs::entity except)
+{
+  flecs::entity closest;
+  float closestDist = FLT_MAX;
+  if (index.cells.empty())
+    return closest;
+  const int cx = pickup_cell_coord(pos.x);
+  const int cy = pickup_cell_coord(pos.y);
+  const int maxRing = std::max(std::max(std::abs(cx - index.minCellX), std::abs(index.maxCellX - cx)),
+                               std::max(std::abs(cy - index.minCellY), std::abs(index.maxCellY - cy)));
+  auto visitCell = [&](int x, int y)
+  {
+    const auto itf = index.cells.find(pickup_cell_key(x, y));
+    if (itf == index.cells.end())
+      return;
+    for (flecs::entity pickup : itf->second)
+    {
+      if (pickup == except)
+        continue;
+      const float curDist = dist(index.positions.at(pickup.id()), pos);
+      if (curDist < closestDist || (curDist == closestDist && pickup.id() < closest.id()))
+      {
+        closestDist = curDist;
+        closest = pickup;
+      }
+    }
+  };
+  // everything in ring r is more than (r - 1) * cellSize away
+  for (int ring = 0; ring <= maxRing; ++ring)
+  {
+    if (float(std::max(0, ring - 1) * PickupIndex::cellSize) > closestDist)
+      break;
+    if (ring == 0)
+    {
+      visitCell(cx, cy);
+      continue;
+    }
+    for (int x = cx - ring; x <= cx + ring; ++x)
+    {
+      visitCell(x, cy - ring);
+      visitCell(x, cy + ring);
+    }
+    for (int y = cy - ring + 1; y <= cy + ring - 1; ++y)
+    {
+      visitCell(cx - ring, y);
+      visitCell(cx + ring, y);
+    }
+  }
+  return closest;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <flecs.h>
+#include "ecsTypes.h"
+
+// Pickups bucketed by square cells of the tile they lie on. Observers keep it
+// up to date as pickups are created and picked up.
+struct PickupIndex
+{
+  static constexpr int cellSize = 8;
+
+  std::unordered_map<uint64_t, std::vector<flecs::entity>> cells; // in creation order
+  std::unordered_map<flecs::entity_t, Position> positions;
+  // cells ever used, only grows so it stays a valid bound for searches
+  int minCellX = 0;
+  int minCellY = 0;
+  int maxCellX = -1;
+  int maxCellY = -1;
+};
+
+// creates the index and its observers, has to be called before pickups appear
+void register_pickup_index(flecs::world &ecs);
+
+// Closest pickup other than except, the one with the smallest id if several
+// are as close. Invalid entity if there is none.
+flecs::entity find_closest_pickup(const PickupIndex &index, const Position &pos, flecs::entity except);
+
+uint64_t pickup_cell_key(int cell_x, int cell_y);
+int pickup_cell_coord(int v);
+
+// Calls c for every pickup lying exactly on pos, in creation order.
+template<typename Callable>
+inline void for_each_pickup_at(const PickupIndex &index, const Position &pos, Callable c)
+{
+  const auto itf = index.cells.find(pickup_cell_key(pickup_cell_coord(pos.x), pickup_cell_coord(pos.y)));
+  if (itf == index.cells.end())
+    return;
+  for (flecs::entity pickup : itf->second)
+    if (index.positions.at(pickup.id()) == pos)
+      c(pickup);
+}
+
+template<typename Callable>
+inline void query_pickup_index(flecs::world &ecs, Callable c)
+{
+  static auto pickupIndexQuery = ecs.query<const PickupIndex>();
+
+  pickupIndexQuery.each(c);
+}
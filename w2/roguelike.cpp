@@ -4,6 +4,7 @@
 #include "stateMachine.h"
 #include "aiLibrary.h"
 #include "blackboard.h"
+#include "pickupIndex.h"
 
 
 static void create_minotaur_beh(flecs::entity e)
@@ -202,6 +203,7 @@ static void register_roguelike_systems(flecs::world &ecs)
 void init_roguelike(flecs::world &ecs)
 {
   register_roguelike_systems(ecs);
+  register_pickup_index(ecs);
 
   ecs.entity("swordsman_tex")
     .set(Texture2D{LoadTexture("assets/swordsman.png")});
@@ -318,27 +320,28 @@ static void process_actions(flecs::world &ecs)
 
   static auto playerPickup = ecs.query<const IsPlayer, const Position, Hitpoints, MeleeDamage>();
   static auto creaturePickup = ecs.query<const Position, Hitpoints, MeleeDamage>();
-  static auto healPickup = ecs.query<const Position, const HealAmount>();
-  static auto powerupPickup = ecs.query<const Position, const PowerupAmount>();
   ecs.defer([&]
   {
-    creaturePickup.each([&](const Position &pos, Hitpoints &hp, MeleeDamage &dmg)
+    query_pickup_index(ecs, [&](const PickupIndex &pickups)
     {
-      healPickup.each([&](flecs::entity entity, const Position &ppos, const HealAmount &amt)
+      creaturePickup.each([&](const Position &pos, Hitpoints &hp, MeleeDamage &dmg)
       {
-        if (pos == ppos)
+        for_each_pickup_at(pickups, pos, [&](flecs::entity pickup)
         {
-          hp.hitpoints += amt.amount;
-          entity.destruct();
-        }
-      });
-      powerupPickup.each([&](flecs::entity entity, const Position &ppos, const PowerupAmount &amt)
-      {
-        if (pos == ppos)
+          if (const HealAmount *amt = pickup.get<HealAmount>())
+          {
+            hp.hitpoints += amt->amount;
+            pickup.destruct();
+          }
+        });
+        for_each_pickup_at(pickups, pos, [&](flecs::entity pickup)
         {
-          dmg.damage += amt.amount;
-          entity.destruct();
-        }
+          if (const PowerupAmount *amt = pickup.get<PowerupAmount>())
+          {
+            dmg.damage += amt->amount;
+            pickup.destruct();
+          }
+        });
       });
     });
   });
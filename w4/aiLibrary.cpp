@@ -79,16 +79,12 @@ public:
   EnemyAvailableTransition(float in_dist) : triggerDist(in_dist) {}
   bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
   {
-    static auto enemiesQuery = ecs.query<const Position, const Team>();
     bool enemiesFound = false;
-    entity.get([&](const Position &pos, const Team &t)
+    query_spatial_grid(ecs, [&](const SpatialGrid &grid)
     {
-      enemiesQuery.each([&](const Position &epos, const Team &et)
+      entity.get([&](const Position &pos, const Team &t)
       {
-        if (t.team == et.team)
-          return;
-        float curDist = dist(epos, pos);
-        enemiesFound |= curDist <= triggerDist;
+        enemiesFound = nearest_enemy(grid, pos, t.team, triggerDist) != nullptr;
       });
     });
     return enemiesFound;
@@ -18,11 +18,12 @@ StateTransition *create_hitpoints_less_than_transition(float thres);
 StateTransition *create_negate_transition(StateTransition *in);
 StateTransition *create_and_transition(StateTransition *lhs, StateTransition *rhs);
 
-using utility_function = std::function<float(Blackboard&)>;
-
 BehNode *sequence(const std::vector<BehNode*> &nodes);
 BehNode *selector(const std::vector<BehNode*> &nodes);
 BehNode *utility_selector(const std::vector<std::pair<BehNode*, utility_function>> &nodes);
+BehNode *utility_selector(const std::vector<std::pair<BehNode*, LinearUtility>> &nodes);
+BehNode *utility_selector(const std::vector<std::pair<BehNode*, CurveUtility>> &nodes);
+BehNode *reactive(BehNode *node);
 
 BehNode *move_to_entity(flecs::entity entity, const char *bb_name);
 BehNode *is_low_hp(float thres);
@@ -31,3 +32,9 @@ BehNode *flee(flecs::entity entity, const char *bb_name);
 BehNode *patrol(flecs::entity entity, float patrol_dist, const char *bb_name);
 BehNode *patch_up(float thres);
 
+// entity-less leaves for shared tree definitions, see bind_beh_tree
+BehNode *move_to_entity(const char *bb_name);
+BehNode *find_enemy(float dist, const char *bb_name);
+BehNode *flee(const char *bb_name);
+BehNode *patrol(float patrol_dist, const char *bb_name);
+
@@ -3,6 +3,7 @@
 #include "blackboard.h"
 #include <float.h>
 #include "math.h"
+#include "spatialGrid.h"
 
 template<typename T, typename U>
 inline int move_towards(const T &from, const U &to)
@@ -38,26 +39,13 @@ static Position move_pos(Position pos, int action)
 template<typename Callable>
 inline void on_closest_enemy_pos(flecs::world &ecs, flecs::entity entity, Callable c)
 {
-  static auto enemiesQuery = ecs.query<const Position, const Team>();
-  entity.set([&](const Position &pos, const Team &t, Action &a)
+  query_spatial_grid(ecs, [&](const SpatialGrid &grid)
   {
-    flecs::entity closestEnemy;
-    float closestDist = FLT_MAX;
-    Position closestPos;
-    enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
+    entity.set([&](const Position &pos, const Team &t, Action &a)
     {
-      if (t.team == et.team)
-        return;
-      float curDist = dist(epos, pos);
-      if (curDist < closestDist)
-      {
-        closestDist = curDist;
-        closestPos = epos;
-        closestEnemy = enemy;
-      }
+      if (const SpatialGrid::Entry *enemy = nearest_enemy(grid, pos, t.team))
+        c(a, pos, enemy->pos);
     });
-    if (ecs.is_valid(closestEnemy))
-      c(a, pos, closestPos);
   });
 }
 
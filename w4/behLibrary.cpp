@@ -5,6 +5,180 @@
 #include "raylib.h"
 #include "blackboard.h"
 #include <algorithm>
+#include <cassert>
+#include <thread>
+
+// leaf logic shared by the node classes and the flat tree interpreter
+static BehResult move_to_entity_update(flecs::entity entity, Blackboard &bb, size_t entity_bb)
+{
+  BehResult res = BEH_RUNNING;
+  entity.set([&](Action &a, const Position &pos)
+  {
+    flecs::entity targetEntity = bb.get<flecs::entity>(entity_bb);
+    if (!targetEntity.is_alive())
+    {
+      res = BEH_FAIL;
+      return;
+    }
+    targetEntity.get([&](const Position &target_pos)
+    {
+      if (pos != target_pos)
+      {
+        a.action = move_towards(pos, target_pos);
+        res = BEH_RUNNING;
+      }
+      else
+        res = BEH_SUCCESS;
+    });
+  });
+  return res;
+}
+
+static BehResult is_low_hp_update(flecs::entity entity, float threshold)
+{
+  BehResult res = BEH_SUCCESS;
+  entity.get([&](const Hitpoints &hp)
+  {
+    res = hp.hitpoints < threshold ? BEH_SUCCESS : BEH_FAIL;
+  });
+  return res;
+}
+
+static BehResult find_enemy_update(flecs::world &ecs, flecs::entity entity, Blackboard &bb,
+                                   size_t entity_bb, float distance)
+{
+  BehResult res = BEH_FAIL;
+  query_spatial_grid(ecs, [&](const SpatialGrid &grid)
+  {
+    entity.set([&](const Position &pos, const Team &t)
+    {
+      const SpatialGrid::Entry *enemy = nearest_enemy(grid, pos, t.team, distance);
+      if (enemy && ecs.is_valid(enemy->entity))
+      {
+        bb.set<flecs::entity>(entity_bb, enemy->entity);
+        res = BEH_SUCCESS;
+      }
+    });
+  });
+  return res;
+}
+
+static BehResult flee_update(flecs::entity entity, Blackboard &bb, size_t entity_bb)
+{
+  BehResult res = BEH_RUNNING;
+  entity.set([&](Action &a, const Position &pos)
+  {
+    flecs::entity targetEntity = bb.get<flecs::entity>(entity_bb);
+    if (!targetEntity.is_alive())
+    {
+      res = BEH_FAIL;
+      return;
+    }
+    targetEntity.get([&](const Position &target_pos)
+    {
+      a.action = inverse_move(move_towards(pos, target_pos));
+    });
+  });
+  return res;
+}
+
+static BehResult patrol_update(flecs::entity entity, Blackboard &bb, size_t ppos_bb, float patrol_dist)
+{
+  BehResult res = BEH_RUNNING;
+  entity.set([&](Action &a, const Position &pos)
+  {
+    Position patrolPos = bb.get<Position>(ppos_bb);
+    if (dist(pos, patrolPos) > patrol_dist)
+      a.action = move_towards(pos, patrolPos);
+    else
+      a.action = GetRandomValue(EA_MOVE_START, EA_MOVE_END - 1); // do a random walk
+  });
+  return res;
+}
+
+static BehResult patch_up_update(flecs::entity entity, float hp_threshold)
+{
+  BehResult res = BEH_SUCCESS;
+  entity.set([&](Action &a, Hitpoints &hp)
+  {
+    if (hp.hitpoints >= hp_threshold)
+      return;
+    res = BEH_RUNNING;
+    a.action = EA_HEAL_SELF;
+  });
+  return res;
+}
+
+static uint32_t reg_flat_bb_var(FlatBehaviourTree &tree, const char *bb_name, BbVarType type)
+{
+  for (size_t i = 0; i < tree.bbVars.size(); ++i)
+    if (tree.bbVars[i].type == type && tree.bbVars[i].name == bb_name)
+      return uint32_t(i);
+  tree.bbVars.push_back(BbVarDesc{bb_name, type});
+  return uint32_t(tree.bbVars.size() - 1);
+}
+
+// Per update scratch of a utility selector, on the stack for up to
+// max_utility_children children and on the heap for bigger selectors.
+template<typename T>
+struct UtilityScratch
+{
+  T local[max_utility_children] = {};
+  std::vector<T> heap;
+  T *data = local;
+
+  explicit UtilityScratch(size_t count)
+  {
+    if (count > max_utility_children)
+    {
+      heap.resize(count);
+      data = heap.data();
+    }
+  }
+  UtilityScratch(const UtilityScratch &) = delete;
+  UtilityScratch &operator=(const UtilityScratch &) = delete;
+
+  T &operator[](size_t i) { return data[i]; }
+};
+
+// Tries children best score first. Instead of sorting all scores up front the
+// next best one is only searched for when the previous child failed.
+template<typename Callable>
+static BehResult select_by_utility(const float *scores, size_t count, size_t skip, Callable update_child)
+{
+  UtilityScratch<uint8_t> tried(count);
+  if (skip < count)
+    tried[skip] = true;
+  for (;;)
+  {
+    size_t best = count;
+    for (size_t i = 0; i < count; ++i)
+      if (!tried[i] && (best == count || scores[i] > scores[best]))
+        best = i;
+    if (best == count)
+      return BEH_FAIL;
+    tried[best] = true;
+    BehResult res = update_child(best);
+    if (res != BEH_FAIL)
+      return res;
+  }
+}
+
+static void push_flat_leaf(FlatBehaviourTree &tree, BehNodeType type, float param)
+{
+  FlatBehNode node;
+  node.type = type;
+  node.subtreeEnd = uint32_t(tree.nodes.size() + 1);
+  node.param = param;
+  tree.nodes.push_back(node);
+}
+
+static void push_flat_leaf(FlatBehaviourTree &tree, BehNodeType type, const char *bb_name, BbVarType bb_type,
+                           float param)
+{
+  push_flat_leaf(tree, type, param);
+  tree.nodes.back().bbVar = reg_flat_bb_var(tree, bb_name, bb_type);
+}
 
 struct CompoundNode : public BehNode
 {
@@ -22,6 +196,15 @@ struct CompoundNode : public BehNode
     nodes.push_back(node);
     return *this;
   }
+
+  void flattenCompound(FlatBehaviourTree &tree, BehNodeType type) const
+  {
+    const size_t idx = tree.nodes.size();
+    tree.nodes.push_back(FlatBehNode{type});
+    for (const BehNode *node : nodes)
+      node->flatten(tree);
+    tree.nodes[idx].subtreeEnd = uint32_t(tree.nodes.size());
+  }
 };
 
 struct Sequence : public CompoundNode
@@ -36,6 +219,11 @@ struct Sequence : public CompoundNode
     }
     return BEH_SUCCESS;
   }
+
+  void flatten(FlatBehaviourTree &tree) const override
+  {
+    flattenCompound(tree, BEH_SEQUENCE);
+  }
 };
 
 struct Selector : public CompoundNode
@@ -50,66 +238,111 @@ struct Selector : public CompoundNode
     }
     return BEH_FAIL;
   }
+
+  void flatten(FlatBehaviourTree &tree) const override
+  {
+    flattenCompound(tree, BEH_SELECTOR);
+  }
 };
 
+static void add_utility_input(FlatBehaviourTree &tree, BbKey<float> input)
+{
+  for (const BbKey<float> &existing : tree.utilityInputs)
+    if (existing.idx == input.idx)
+      return;
+  tree.utilityInputs.push_back(input);
+}
+
 struct UtilitySelector : public BehNode
 {
   std::vector<std::pair<BehNode*, utility_function>> utilityNodes;
+  std::vector<LinearUtility> linearUtilities; // used where the function is nullptr
+  std::vector<CurveUtility> curveUtilities; // used instead of linear ones when not empty
+
+  ~UtilitySelector()
+  {
+    for (auto &utilityNode : utilityNodes)
+      delete utilityNode.first;
+  }
 
   BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
-    std::vector<std::pair<float, size_t>> utilityScores;
+    UtilityScratch<float> scores(utilityNodes.size());
     for (size_t i = 0; i < utilityNodes.size(); ++i)
+      scores[i] = utilityNodes[i].second ? utilityNodes[i].second(bb) :
+                  !curveUtilities[i].considerations.empty() ? curve_utility_score(curveUtilities[i], bb) :
+                  linear_utility_score(linearUtilities[i], bb);
+    return select_by_utility(scores.data, utilityNodes.size(), size_t(-1), [&](size_t i)
     {
-      const float utilityScore = utilityNodes[i].second(bb);
-      utilityScores.push_back(std::make_pair(utilityScore, i));
-    }
-    std::sort(utilityScores.begin(), utilityScores.end(), [](auto &lhs, auto &rhs)
-    {
-      return lhs.first > rhs.first;
+      return utilityNodes[i].first->update(ecs, entity, bb);
     });
-    for (const std::pair<float, size_t> &node : utilityScores)
+  }
+
+  void flatten(FlatBehaviourTree &tree) const override
+  {
+    const size_t idx = tree.nodes.size();
+    FlatBehNode node;
+    node.type = BEH_UTILITY_SELECTOR;
+    node.utilityStart = uint32_t(tree.utilities.size());
+    tree.nodes.push_back(node);
+    // utilities of our children go first, nested selectors append theirs after
+    for (size_t i = 0; i < utilityNodes.size(); ++i)
     {
-      size_t nodeIdx = node.second;
-      BehResult res = utilityNodes[nodeIdx].first->update(ecs, entity, bb);
-      if (res != BEH_FAIL)
-        return res;
+      tree.utilities.push_back(utilityNodes[i].second);
+      tree.linearUtilities.push_back(utilityNodes[i].second ? LinearUtility{} : linearUtilities[i]);
+      tree.curveUtilities.push_back(utilityNodes[i].second ? CurveUtility{} : curveUtilities[i]);
+      for (const UtilityTerm &term : tree.linearUtilities.back().terms)
+        add_utility_input(tree, term.input);
+      for (const Consideration &consideration : tree.curveUtilities.back().considerations)
+        add_utility_input(tree, consideration.input);
     }
-    return BEH_FAIL;
+    for (const auto &utilityNode : utilityNodes)
+      utilityNode.first->flatten(tree);
+    tree.nodes[idx].subtreeEnd = uint32_t(tree.nodes.size());
+  }
+};
+
+// Leaves constructed without an entity have no blackboard slots and are only
+// meant to be flattened into a shared tree definition.
+// Marks its child as a guard that is re-checked when a resuming tree skips
+// over it, the pointer based tree always runs from the root so it only forwards.
+struct Reactive : public BehNode
+{
+  BehNode *node = nullptr;
+  Reactive(BehNode *in_node) : node(in_node) {}
+  ~Reactive() { delete node; }
+
+  BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
+  {
+    return node->update(ecs, entity, bb);
+  }
+
+  void flatten(FlatBehaviourTree &tree) const override
+  {
+    const size_t idx = tree.nodes.size();
+    node->flatten(tree);
+    tree.nodes[idx].flags |= BEH_FLAG_REACTIVE;
   }
 };
 
 struct MoveToEntity : public BehNode
 {
   size_t entityBb = size_t(-1); // wraps to 0xff...
-  MoveToEntity(flecs::entity entity, const char *bb_name)
+  const char *bbName = nullptr;
+  MoveToEntity(const char *bb_name) : bbName(bb_name) {}
+  MoveToEntity(flecs::entity entity, const char *bb_name) : bbName(bb_name)
   {
     entityBb = reg_entity_blackboard_var<flecs::entity>(entity, bb_name);
   }
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_RUNNING;
-    entity.set([&](Action &a, const Position &pos)
-    {
-      flecs::entity targetEntity = bb.get<flecs::entity>(entityBb);
-      if (!targetEntity.is_alive())
-      {
-        res = BEH_FAIL;
-        return;
-      }
-      targetEntity.get([&](const Position &target_pos)
-      {
-        if (pos != target_pos)
-        {
-          a.action = move_towards(pos, target_pos);
-          res = BEH_RUNNING;
-        }
-        else
-          res = BEH_SUCCESS;
-      });
-    });
-    return res;
+    return move_to_entity_update(entity, bb, entityBb);
+  }
+
+  void flatten(FlatBehaviourTree &tree) const override
+  {
+    push_flat_leaf(tree, BEH_MOVE_TO_ENTITY, bbName, BB_ENTITY, 0.f);
   }
 };
 
@@ -120,88 +353,65 @@ struct IsLowHp : public BehNode
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &) override
   {
-    BehResult res = BEH_SUCCESS;
-    entity.get([&](const Hitpoints &hp)
-    {
-      res = hp.hitpoints < threshold ? BEH_SUCCESS : BEH_FAIL;
-    });
-    return res;
+    return is_low_hp_update(entity, threshold);
+  }
+
+  void flatten(FlatBehaviourTree &tree) const override
+  {
+    push_flat_leaf(tree, BEH_IS_LOW_HP, threshold);
   }
 };
 
 struct FindEnemy : public BehNode
 {
   size_t entityBb = size_t(-1);
+  const char *bbName = nullptr;
   float distance = 0;
-  FindEnemy(flecs::entity entity, float in_dist, const char *bb_name) : distance(in_dist)
+  FindEnemy(float in_dist, const char *bb_name) : bbName(bb_name), distance(in_dist) {}
+  FindEnemy(flecs::entity entity, float in_dist, const char *bb_name) : bbName(bb_name), distance(in_dist)
   {
     entityBb = reg_entity_blackboard_var<flecs::entity>(entity, bb_name);
   }
   BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_FAIL;
-    static auto enemiesQuery = ecs.query<const Position, const Team>();
-    entity.set([&](const Position &pos, const Team &t)
-    {
-      flecs::entity closestEnemy;
-      float closestDist = FLT_MAX;
-      Position closestPos;
-      enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
-      {
-        if (t.team == et.team)
-          return;
-        float curDist = dist(epos, pos);
-        if (curDist < closestDist)
-        {
-          closestDist = curDist;
-          closestPos = epos;
-          closestEnemy = enemy;
-        }
-      });
-      if (ecs.is_valid(closestEnemy) && closestDist <= distance)
-      {
-        bb.set<flecs::entity>(entityBb, closestEnemy);
-        res = BEH_SUCCESS;
-      }
-    });
-    return res;
+    return find_enemy_update(ecs, entity, bb, entityBb, distance);
+  }
+
+  void flatten(FlatBehaviourTree &tree) const override
+  {
+    push_flat_leaf(tree, BEH_FIND_ENEMY, bbName, BB_ENTITY, distance);
   }
 };
 
 struct Flee : public BehNode
 {
   size_t entityBb = size_t(-1);
-  Flee(flecs::entity entity, const char *bb_name)
+  const char *bbName = nullptr;
+  Flee(const char *bb_name) : bbName(bb_name) {}
+  Flee(flecs::entity entity, const char *bb_name) : bbName(bb_name)
   {
     entityBb = reg_entity_blackboard_var<flecs::entity>(entity, bb_name);
   }
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_RUNNING;
-    entity.set([&](Action &a, const Position &pos)
-    {
-      flecs::entity targetEntity = bb.get<flecs::entity>(entityBb);
-      if (!targetEntity.is_alive())
-      {
-        res = BEH_FAIL;
-        return;
-      }
-      targetEntity.get([&](const Position &target_pos)
-      {
-        a.action = inverse_move(move_towards(pos, target_pos));
-      });
-    });
-    return res;
+    return flee_update(entity, bb, entityBb);
+  }
+
+  void flatten(FlatBehaviourTree &tree) const override
+  {
+    push_flat_leaf(tree, BEH_FLEE, bbName, BB_ENTITY, 0.f);
   }
 };
 
 struct Patrol : public BehNode
 {
   size_t pposBb = size_t(-1);
+  const char *bbName = nullptr;
   float patrolDist = 1.f;
+  Patrol(float patrol_dist, const char *bb_name) : bbName(bb_name), patrolDist(patrol_dist) {}
   Patrol(flecs::entity entity, float patrol_dist, const char *bb_name)
-    : patrolDist(patrol_dist)
+    : bbName(bb_name), patrolDist(patrol_dist)
   {
     pposBb = reg_entity_blackboard_var<Position>(entity, bb_name);
     entity.set([&](Blackboard &bb, const Position &pos)
@@ -212,16 +422,12 @@ struct Patrol : public BehNode
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_RUNNING;
-    entity.set([&](Action &a, const Position &pos)
-    {
-      Position patrolPos = bb.get<Position>(pposBb);
-      if (dist(pos, patrolPos) > patrolDist)
-        a.action = move_towards(pos, patrolPos);
-      else
-        a.action = GetRandomValue(EA_MOVE_START, EA_MOVE_END - 1); // do a random walk
-    });
-    return res;
+    return patrol_update(entity, bb, pposBb, patrolDist);
+  }
+
+  void flatten(FlatBehaviourTree &tree) const override
+  {
+    push_flat_leaf(tree, BEH_PATROL, bbName, BB_POSITION, patrolDist);
   }
 };
 
@@ -232,19 +438,523 @@ struct PatchUp : public BehNode
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &) override
   {
-    BehResult res = BEH_SUCCESS;
-    entity.set([&](Action &a, Hitpoints &hp)
+    return patch_up_update(entity, hpThreshold);
+  }
+
+  void flatten(FlatBehaviourTree &tree) const override
+  {
+    push_flat_leaf(tree, BEH_PATCH_UP, hpThreshold);
+  }
+};
+
+// Random move from a per agent xorshift, unlike GetRandomValue it is safe to
+// call from worker threads and doesn't depend on the order agents are ticked in.
+static int random_move(uint32_t &random_state)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return EA_MOVE_START + int(random_state % uint32_t(EA_MOVE_END - EA_MOVE_START));
+}
+
+// Same logic as the leaf functions above, but reading the turn snapshot instead
+// of the world so it can run on worker threads.
+static BehResult update_flat_leaf(const FlatBehNode &node, BehaviourTreeState &state,
+                                  const BehWorldSnapshot &world, const BehAgent &agent, Blackboard &bb)
+{
+  switch (node.type)
+  {
+    case BEH_MOVE_TO_ENTITY:
     {
-      if (hp.hitpoints >= hpThreshold)
-        return;
-      res = BEH_RUNNING;
-      a.action = EA_HEAL_SELF;
-    });
-    return res;
+      const Position *targetPos = world.find(bb.get<flecs::entity>(state.binding->bbSlots[node.bbVar]));
+      if (!targetPos)
+        return BEH_FAIL;
+      if (agent.pos == *targetPos)
+        return BEH_SUCCESS;
+      agent.action->action = move_towards(agent.pos, *targetPos);
+      return BEH_RUNNING;
+    }
+    case BEH_IS_LOW_HP:
+      return agent.hitpoints < node.param ? BEH_SUCCESS : BEH_FAIL;
+    case BEH_FIND_ENEMY:
+    {
+      const SpatialGrid::Entry *enemy = nearest_enemy(*world.grid, agent.pos, agent.team, node.param);
+      if (!enemy)
+        return BEH_FAIL;
+      bb.set<flecs::entity>(state.binding->bbSlots[node.bbVar], enemy->entity);
+      return BEH_SUCCESS;
+    }
+    case BEH_FLEE:
+    {
+      const Position *targetPos = world.find(bb.get<flecs::entity>(state.binding->bbSlots[node.bbVar]));
+      if (!targetPos)
+        return BEH_FAIL;
+      agent.action->action = inverse_move(move_towards(agent.pos, *targetPos));
+      return BEH_RUNNING;
+    }
+    case BEH_PATROL:
+    {
+      const Position patrolPos = bb.get<Position>(state.binding->bbSlots[node.bbVar]);
+      if (dist(agent.pos, patrolPos) > node.param)
+        agent.action->action = move_towards(agent.pos, patrolPos);
+      else
+        agent.action->action = random_move(state.randomState); // do a random walk
+      return BEH_RUNNING;
+    }
+    case BEH_PATCH_UP:
+      if (agent.hitpoints >= node.param)
+        return BEH_SUCCESS;
+      agent.action->action = EA_HEAL_SELF;
+      return BEH_RUNNING;
+    default:
+      break;
+  }
+  return BEH_FAIL;
+}
+
+static float flat_utility_score(const FlatBehaviourTree &tree, const BehaviourTreeState &state, size_t idx,
+                                Blackboard &bb)
+{
+  if (tree.utilities[idx])
+    return tree.utilities[idx](bb);
+  if (state.utilityScores)
+    return state.utilityScores[idx];
+  if (!tree.curveUtilities[idx].considerations.empty())
+    return curve_utility_score(tree.curveUtilities[idx], bb);
+  return linear_utility_score(tree.linearUtilities[idx], bb);
+}
+
+static bool is_in_subtree(const FlatBehaviourTree &tree, uint32_t idx, uint32_t node)
+{
+  return node >= idx && node < tree.nodes[idx].subtreeEnd;
+}
+
+// When resuming, siblings before the running path were passed on an earlier
+// turn and are skipped, except reactive ones which are re-checked as guards.
+// Event driven trees only re-check guards if something they read changed.
+static bool skip_on_resume(const FlatBehaviourTree &tree, const BehaviourTreeState &state, uint32_t child,
+                           uint32_t resume)
+{
+  return resume != BEH_NO_NODE && tree.nodes[child].subtreeEnd <= resume &&
+         (!state.dirty || !(tree.nodes[child].flags & BEH_FLAG_REACTIVE));
+}
+
+static BehResult update_flat_node(const FlatBehaviourTree &tree, BehaviourTreeState &state, uint32_t idx,
+                                  uint32_t resume, const BehWorldSnapshot &world, const BehAgent &agent,
+                                  Blackboard &bb)
+{
+  const FlatBehNode &node = tree.nodes[idx];
+  switch (node.type)
+  {
+    case BEH_SEQUENCE:
+      for (uint32_t child = idx + 1; child < node.subtreeEnd; child = tree.nodes[child].subtreeEnd)
+      {
+        if (skip_on_resume(tree, state, child, resume))
+          continue;
+        const uint32_t childResume = is_in_subtree(tree, child, resume) ? resume : BEH_NO_NODE;
+        BehResult res = update_flat_node(tree, state, child, childResume, world, agent, bb);
+        if (res != BEH_SUCCESS)
+          return res;
+      }
+      return BEH_SUCCESS;
+    case BEH_SELECTOR:
+      for (uint32_t child = idx + 1; child < node.subtreeEnd; child = tree.nodes[child].subtreeEnd)
+      {
+        if (skip_on_resume(tree, state, child, resume))
+          continue;
+        const uint32_t childResume = is_in_subtree(tree, child, resume) ? resume : BEH_NO_NODE;
+        BehResult res = update_flat_node(tree, state, child, childResume, world, agent, bb);
+        if (res != BEH_FAIL)
+          return res;
+      }
+      return BEH_FAIL;
+    case BEH_UTILITY_SELECTOR:
+    {
+      // keep running the chosen child, only re-score once it fails
+      uint32_t resumedChild = BEH_NO_NODE;
+      for (uint32_t child = idx + 1; resume != BEH_NO_NODE && child < node.subtreeEnd; child = tree.nodes[child].subtreeEnd)
+      {
+        if (!is_in_subtree(tree, child, resume))
+          continue;
+        BehResult res = update_flat_node(tree, state, child, resume, world, agent, bb);
+        if (res != BEH_FAIL)
+          return res;
+        resumedChild = child;
+        break;
+      }
+      size_t numChildren = 0;
+      for (uint32_t child = idx + 1; child < node.subtreeEnd; child = tree.nodes[child].subtreeEnd)
+        numChildren++;
+      UtilityScratch<float> scores(numChildren);
+      UtilityScratch<uint32_t> children(numChildren);
+      size_t count = 0;
+      size_t skip = size_t(-1);
+      for (uint32_t child = idx + 1; child < node.subtreeEnd; child = tree.nodes[child].subtreeEnd, ++count)
+      {
+        if (child == resumedChild)
+          skip = count;
+        children[count] = child;
+        scores[count] = flat_utility_score(tree, state, node.utilityStart + count, bb);
+      }
+      return select_by_utility(scores.data, count, skip, [&](size_t i)
+      {
+        return update_flat_node(tree, state, children[i], BEH_NO_NODE, world, agent, bb);
+      });
+    }
+    default:
+    {
+      BehResult res = update_flat_leaf(node, state, world, agent, bb);
+      if (res == BEH_RUNNING)
+        state.runningNode = idx;
+      return res;
+    }
+  }
+}
+
+void BehaviourTreeState::update(const BehWorldSnapshot &world, const BehAgent &agent, Blackboard &bb)
+{
+  if (!binding || binding->tree->nodes.empty())
+    return;
+  const FlatBehaviourTree &tree = *binding->tree;
+  if (!tree.eventDriven || ((tree.dependencies & BEH_DEP_BLACKBOARD) && bb.getVersion() != bbVersion))
+    dirty = true;
+  // nothing the conditions read has changed and no action is running, the
+  // tree would come to the same result
+  if (!dirty && runningNode == BEH_NO_NODE)
+  {
+    utilityScores = nullptr;
+    return;
+  }
+  const uint32_t resume = tree.resumeRunning ? runningNode : BEH_NO_NODE;
+  runningNode = BEH_NO_NODE;
+  update_flat_node(tree, *this, 0, resume, world, agent, bb);
+  utilityScores = nullptr;
+  dirty = false;
+  bbVersion = bb.getVersion();
+}
+
+float linear_utility_score(const LinearUtility &utility, const Blackboard &bb)
+{
+  float score = utility.bias;
+  for (const UtilityTerm &term : utility.terms)
+    score += term.weight * bb.get(term.input);
+  return score;
+}
+
+struct UtilityBatch
+{
+  const FlatBehaviourTree *tree = nullptr;
+  std::vector<BehaviourTreeState*> states;
+  std::vector<const Blackboard*> blackboards;
+  std::vector<float> utilityScores; // a row of all utilities of the tree per agent
+};
+
+static const float *find_utility_column(const FlatBehaviourTree &tree, const std::vector<float> &columns,
+                                        size_t count, BbKey<float> input)
+{
+  size_t column = 0;
+  while (tree.utilityInputs[column].idx != input.idx)
+    ++column;
+  return columns.data() + column * count;
+}
+
+// Agents sharing a definition have their utility inputs gathered into one
+// column per blackboard float, then every utility is scored for all of them
+// in one loop per term or consideration. Linear terms are plain multiply-adds
+// which vectorize, curves are table lookups.
+static void score_utility_batch(UtilityBatch &batch, std::vector<float> &columns, std::vector<float> &scores)
+{
+  const FlatBehaviourTree &tree = *batch.tree;
+  const size_t count = batch.states.size();
+  const size_t numUtilities = tree.utilities.size();
+  batch.utilityScores.resize(count * numUtilities);
+  columns.resize(tree.utilityInputs.size() * count);
+  scores.resize(count);
+  for (size_t input = 0; input < tree.utilityInputs.size(); ++input)
+    for (size_t i = 0; i < count; ++i)
+      columns[input * count + i] = batch.blackboards[i]->get(tree.utilityInputs[input]);
+
+  for (size_t utilityIdx = 0; utilityIdx < tree.utilities.size(); ++utilityIdx)
+  {
+    if (tree.utilities[utilityIdx])
+      continue;
+    const CurveUtility &curveUtility = tree.curveUtilities[utilityIdx];
+    if (!curveUtility.considerations.empty())
+    {
+      std::fill(scores.begin(), scores.end(), curveUtility.weight);
+      for (const Consideration &consideration : curveUtility.considerations)
+      {
+        const float *column = find_utility_column(tree, columns, count, consideration.input);
+        const size_t numConsiderations = curveUtility.considerations.size();
+        for (size_t i = 0; i < count; ++i)
+          scores[i] *= compensate_consideration(consideration.score(column[i]), numConsiderations);
+      }
+    }
+    else
+    {
+      const LinearUtility &utility = tree.linearUtilities[utilityIdx];
+      std::fill(scores.begin(), scores.end(), utility.bias);
+      for (const UtilityTerm &term : utility.terms)
+      {
+        const float *column = find_utility_column(tree, columns, count, term.input);
+        const float weight = term.weight;
+        float *out = scores.data();
+        for (size_t i = 0; i < count; ++i)
+          out[i] += weight * column[i];
+      }
+    }
+    for (size_t i = 0; i < count; ++i)
+      batch.utilityScores[i * numUtilities + utilityIdx] = scores[i];
+  }
+  for (size_t i = 0; i < count; ++i)
+    batch.states[i]->utilityScores = batch.utilityScores.data() + i * numUtilities;
+}
+
+void batch_beh_tree_utilities(flecs::world &ecs)
+{
+  static auto treesQuery = ecs.query<BehaviourTreeState, const Blackboard>();
+  static std::vector<UtilityBatch> batches;
+  static std::vector<float> columns;
+  static std::vector<float> scores;
+  for (UtilityBatch &batch : batches)
+  {
+    batch.states.clear();
+    batch.blackboards.clear();
   }
+  treesQuery.each([&](BehaviourTreeState &state, const Blackboard &bb)
+  {
+    // without inputs linear utilities are constants, cheap enough to score inline
+    if (!state.binding || state.binding->tree->utilityInputs.empty())
+      return;
+    const FlatBehaviourTree *tree = state.binding->tree.get();
+    auto itf = std::find_if(batches.begin(), batches.end(),
+                            [&](const UtilityBatch &batch) { return batch.tree == tree; });
+    if (itf == batches.end())
+      itf = batches.insert(batches.end(), UtilityBatch{tree, {}, {}, {}});
+    itf->states.push_back(&state);
+    itf->blackboards.push_back(&bb);
+  });
+  // definitions nobody uses anymore may be gone, forget about them
+  batches.erase(std::remove_if(batches.begin(), batches.end(),
+                               [](const UtilityBatch &batch) { return batch.states.empty(); }),
+                batches.end());
+  for (UtilityBatch &batch : batches)
+    score_utility_batch(batch, columns, scores);
+}
+
+// Characters whose Position was set since the last tick, collected by the
+// observer and checked against the spatial grid once per tick.
+struct BehTreeMovers
+{
+  std::vector<flecs::entity> movers;
+  float maxEnemyRange = 0.f; // widest enemyRange of the bound trees
+};
+
+static void mark_dirty_if_enemy_near(BehaviourTreeState &state, const Position &pos, const Team &team,
+                                     const Position &other_pos, const Team &other_team)
+{
+  if (state.dirty || !state.binding || !(state.binding->tree->dependencies & BEH_DEP_ENEMIES) ||
+      team.team == other_team.team)
+    return;
+  if (dist(pos, other_pos) <= state.binding->tree->enemyRange)
+    state.dirty = true;
+}
+
+static void mark_beh_trees_near_movers(flecs::world &ecs, const SpatialGrid &grid)
+{
+  static auto moversQuery = ecs.query<BehTreeMovers>();
+  moversQuery.each([&](BehTreeMovers &movers)
+  {
+    for (flecs::entity mover : movers.movers)
+    {
+      if (!mover.is_alive())
+        continue;
+      mover.get([&](const Position &pos, const Team &team)
+      {
+        // agents which have the mover in range now, the radius is exclusive
+        for_each_in_radius(grid, pos, movers.maxEnemyRange + 1.f, [&](const SpatialGrid::Entry &entry)
+        {
+          if (entry.team != team.team && entry.entity.has<BehaviourTreeState>())
+            mark_dirty_if_enemy_near(*entry.entity.get_mut<BehaviourTreeState>(), entry.pos, Team{entry.team},
+                                     pos, team);
+        });
+        // and the mover itself may have walked up to enemies
+        if (!mover.has<BehaviourTreeState>())
+          return;
+        BehaviourTreeState &state = *mover.get_mut<BehaviourTreeState>();
+        if (!state.dirty && state.binding && (state.binding->tree->dependencies & BEH_DEP_ENEMIES) &&
+            nearest_enemy(grid, pos, team.team, state.binding->tree->enemyRange))
+          state.dirty = true;
+      });
+    }
+    movers.movers.clear();
+  });
+}
+
+struct BehTreeJob
+{
+  BehaviourTreeState *state;
+  Blackboard *bb;
+  BehAgent agent;
 };
 
+void update_beh_trees(flecs::world &ecs, unsigned num_threads)
+{
+  static auto agentsQuery =
+    ecs.query<BehaviourTreeState, Blackboard, Action, const Position, const Team, const Hitpoints>();
+  static BehWorldSnapshot snapshot;
+  static std::vector<BehTreeJob> jobs;
+  snapshot.grid = nullptr;
+  snapshot.indices.clear();
+  jobs.clear();
+  query_spatial_grid(ecs, [&](const SpatialGrid &grid)
+  {
+    snapshot.grid = &grid;
+  });
+  assert(snapshot.grid && "rebuild_spatial_grid has to be called before update_beh_trees");
+  mark_beh_trees_near_movers(ecs, *snapshot.grid);
+  for (size_t i = 0; i < snapshot.grid->entries.size(); ++i)
+    snapshot.indices.emplace(snapshot.grid->entries[i].entity.id(), i);
+  // Components are only read and written through these pointers until all
+  // workers are joined, no flecs calls happen meanwhile so they stay valid.
+  agentsQuery.each([&](flecs::entity e, BehaviourTreeState &state, Blackboard &bb, Action &a, const Position &pos,
+                       const Team &team, const Hitpoints &hp)
+  {
+    jobs.push_back(BehTreeJob{&state, &bb, BehAgent{e, pos, team.team, hp.hitpoints, &a}});
+  });
+
+  auto tickRange = [&](size_t from, size_t to)
+  {
+    for (size_t i = from; i < to; ++i)
+      jobs[i].state->update(snapshot, jobs[i].agent, *jobs[i].bb);
+  };
+  // starting a thread costs about as much as ticking a few hundred trees
+  constexpr size_t minJobsPerThread = 256;
+  if (num_threads == 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  const size_t numWorkers = std::min<size_t>(num_threads, (jobs.size() + minJobsPerThread - 1) / minJobsPerThread);
+  if (numWorkers <= 1)
+  {
+    tickRange(0, jobs.size());
+    return;
+  }
+  // every agent only writes its own state, blackboard and action, so splitting
+  // into contiguous chunks gives the same result as ticking them in order
+  const size_t chunk = (jobs.size() + numWorkers - 1) / numWorkers;
+  std::vector<std::thread> workers;
+  workers.reserve(numWorkers - 1);
+  for (size_t i = 1; i < numWorkers; ++i)
+    workers.emplace_back(tickRange, i * chunk, std::min(jobs.size(), (i + 1) * chunk));
+  tickRange(0, std::min(jobs.size(), chunk));
+  for (std::thread &worker : workers)
+    worker.join();
+}
+
+FlatBehaviourTree flatten_beh_tree(const BehaviourTree &bt)
+{
+  FlatBehaviourTree tree;
+  if (bt.root)
+    bt.root->flatten(tree);
+  for (const FlatBehNode &node : tree.nodes)
+  {
+    switch (node.type)
+    {
+      case BEH_IS_LOW_HP:
+      case BEH_PATCH_UP:
+        tree.dependencies |= BEH_DEP_HITPOINTS;
+        break;
+      case BEH_FIND_ENEMY:
+        tree.dependencies |= BEH_DEP_ENEMIES;
+        tree.enemyRange = std::max(tree.enemyRange, node.param);
+        break;
+      case BEH_UTILITY_SELECTOR:
+        tree.dependencies |= BEH_DEP_BLACKBOARD;
+        break;
+      default:
+        break;
+    }
+  }
+  return tree;
+}
+
+// Game code has to call modified<Hitpoints>() and modified<Position>() when it
+// changes them in place for event driven trees to notice.
+void register_beh_tree_observers(flecs::world &ecs)
+{
+  static auto moversQuery = ecs.query<BehTreeMovers>();
+  ecs.entity("beh_tree_movers")
+    .set(BehTreeMovers{});
+  ecs.observer<const Hitpoints, BehaviourTreeState>()
+    .event(flecs::OnSet)
+    .each([](const Hitpoints &, BehaviourTreeState &state)
+    {
+      if (state.binding && (state.binding->tree->dependencies & BEH_DEP_HITPOINTS))
+        state.dirty = true;
+    });
+  ecs.observer<const BehaviourTreeState>()
+    .event(flecs::OnSet)
+    .each([](const BehaviourTreeState &state)
+    {
+      moversQuery.each([&](BehTreeMovers &movers)
+      {
+        if (state.binding)
+          movers.maxEnemyRange = std::max(movers.maxEnemyRange, state.binding->tree->enemyRange);
+      });
+    });
+  // only remembers the mover, who is near whom is checked once per tick in
+  // update_beh_trees when the spatial grid is up to date
+  ecs.observer<const Position, const Team>()
+    .event(flecs::OnSet)
+    .each([](flecs::entity mover, const Position &, const Team &)
+    {
+      moversQuery.each([&](BehTreeMovers &movers)
+      {
+        movers.movers.push_back(mover);
+      });
+    });
+}
+
+template<typename DataType>
+static size_t bind_bb_var(BlackboardSchema &schema, const std::string &name)
+{
+  return schema.regName<DataType>(intern_bb_name<DataType>(name));
+}
+
+std::shared_ptr<const BehTreeBinding> bind_beh_tree_schema(std::shared_ptr<const FlatBehaviourTree> tree,
+                                                           std::shared_ptr<BlackboardSchema> schema)
+{
+  auto binding = std::make_shared<BehTreeBinding>();
+  binding->bbSlots.reserve(tree->bbVars.size());
+  for (const BbVarDesc &var : tree->bbVars)
+  {
+    switch (var.type)
+    {
+      case BB_FLOAT: binding->bbSlots.push_back(bind_bb_var<float>(*schema, var.name)); break;
+      case BB_INT: binding->bbSlots.push_back(bind_bb_var<int>(*schema, var.name)); break;
+      case BB_ENTITY: binding->bbSlots.push_back(bind_bb_var<flecs::entity>(*schema, var.name)); break;
+      case BB_POSITION: binding->bbSlots.push_back(bind_bb_var<Position>(*schema, var.name)); break;
+    }
+  }
+  binding->tree = std::move(tree);
+  binding->schema = std::move(schema);
+  return binding;
+}
 
+BehaviourTreeState bind_beh_tree(std::shared_ptr<const BehTreeBinding> binding, flecs::entity entity)
+{
+  BehaviourTreeState state;
+  entity.set([&](Blackboard &bb, const Position &pos)
+  {
+    assert(bb.getSchema() == binding->schema.get() && "blackboard doesn't use the schema of the binding");
+    // patrol around the place we were spawned at
+    for (const FlatBehNode &node : binding->tree->nodes)
+      if (node.type == BEH_PATROL)
+        bb.set<Position>(binding->bbSlots[node.bbVar], pos);
+  });
+  state.randomState = uint32_t(entity.id() * 2654435761u) | 1u; // xorshift state must not be zero
+  state.binding = std::move(binding);
+  return state;
+}
 
 BehNode *sequence(const std::vector<BehNode*> &nodes)
 {
@@ -269,11 +979,45 @@ BehNode *utility_selector(const std::vector<std::pair<BehNode*, utility_function
   return usel;
 }
 
+BehNode *utility_selector(const std::vector<std::pair<BehNode*, LinearUtility>> &nodes)
+{
+  UtilitySelector *usel = new UtilitySelector;
+  for (const std::pair<BehNode*, LinearUtility> &node : nodes)
+  {
+    usel->utilityNodes.push_back(std::make_pair(node.first, utility_function(nullptr)));
+    usel->linearUtilities.push_back(node.second);
+    usel->curveUtilities.push_back(CurveUtility{});
+  }
+  return usel;
+}
+
+BehNode *utility_selector(const std::vector<std::pair<BehNode*, CurveUtility>> &nodes)
+{
+  UtilitySelector *usel = new UtilitySelector;
+  for (const std::pair<BehNode*, CurveUtility> &node : nodes)
+  {
+    usel->utilityNodes.push_back(std::make_pair(node.first, utility_function(nullptr)));
+    usel->linearUtilities.push_back(LinearUtility{});
+    usel->curveUtilities.push_back(node.second);
+  }
+  return usel;
+}
+
+BehNode *reactive(BehNode *node)
+{
+  return new Reactive(node);
+}
+
 BehNode *move_to_entity(flecs::entity entity, const char *bb_name)
 {
   return new MoveToEntity(entity, bb_name);
 }
 
+BehNode *move_to_entity(const char *bb_name)
+{
+  return new MoveToEntity(bb_name);
+}
+
 BehNode *is_low_hp(float thres)
 {
   return new IsLowHp(thres);
@@ -284,16 +1028,31 @@ BehNode *find_enemy(flecs::entity entity, float dist, const char *bb_name)
   return new FindEnemy(entity, dist, bb_name);
 }
 
+BehNode *find_enemy(float dist, const char *bb_name)
+{
+  return new FindEnemy(dist, bb_name);
+}
+
 BehNode *flee(flecs::entity entity, const char *bb_name)
 {
   return new Flee(entity, bb_name);
 }
 
+BehNode *flee(const char *bb_name)
+{
+  return new Flee(bb_name);
+}
+
 BehNode *patrol(flecs::entity entity, float patrol_dist, const char *bb_name)
 {
   return new Patrol(entity, patrol_dist, bb_name);
 }
 
+BehNode *patrol(float patrol_dist, const char *bb_name)
+{
+  return new Patrol(patrol_dist, bb_name);
+}
+
 BehNode *patch_up(float thres)
 {
   return new PatchUp(thres);
@@ -1,8 +1,14 @@
 #pragma once
 
 #include <flecs.h>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "blackboard.h"
+#include "responseCurves.h"
+#include "spatialGrid.h"
 
 enum BehResult
 {
@@ -11,10 +17,77 @@ enum BehResult
   BEH_RUNNING
 };
 
+// plain function pointer, captureless lambdas convert to it. Called from worker
+// threads, so it should only read the blackboard through keys made up front.
+using utility_function = float (*)(Blackboard&);
+
+// utility selectors score up to this many children in an inline buffer, bigger
+// ones fall back to the heap
+constexpr size_t max_utility_children = 32;
+
+struct UtilityTerm
+{
+  BbKey<float> input;
+  float weight = 0.f;
+};
+
+// Utility given as a bias plus weighted blackboard floats. Unlike a function it
+// can be scored for all agents sharing a tree in one batched pass.
+struct LinearUtility
+{
+  float bias = 0.f;
+  std::vector<UtilityTerm> terms;
+};
+
+float linear_utility_score(const LinearUtility &utility, const Blackboard &bb);
+
+enum BehNodeType : uint8_t
+{
+  BEH_SEQUENCE,
+  BEH_SELECTOR,
+  BEH_UTILITY_SELECTOR,
+  BEH_MOVE_TO_ENTITY,
+  BEH_IS_LOW_HP,
+  BEH_FIND_ENEMY,
+  BEH_FLEE,
+  BEH_PATROL,
+  BEH_PATCH_UP
+};
+
+enum BehNodeFlags : uint8_t
+{
+  BEH_FLAG_REACTIVE = 1 << 0
+};
+
+constexpr uint32_t BEH_NO_NODE = uint32_t(-1);
+
+// what the conditions of a tree read, changes to these mark event driven trees dirty
+enum BehDependency : uint8_t
+{
+  BEH_DEP_HITPOINTS = 1 << 0,
+  BEH_DEP_ENEMIES = 1 << 1, // enemies within enemyRange
+  BEH_DEP_BLACKBOARD = 1 << 2
+};
+
+// Node of a flattened tree. Nodes are stored in pre-order, so children of a
+// node start right after it and each child's subtreeEnd points to its sibling.
+struct FlatBehNode
+{
+  BehNodeType type = BEH_SEQUENCE;
+  uint8_t flags = 0;
+  uint32_t subtreeEnd = 0;
+  uint32_t utilityStart = 0; // utility selector: first utility of its children
+  uint32_t bbVar = 0; // index into FlatBehaviourTree::bbVars
+  float param = 0.f;
+};
+
+struct FlatBehaviourTree;
+
 struct BehNode
 {
   virtual ~BehNode() {}
   virtual BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) = 0;
+  virtual void flatten(FlatBehaviourTree &tree) const = 0;
 };
 
 struct BehaviourTree
@@ -38,3 +111,97 @@ struct BehaviourTree
   }
 };
 
+enum BbVarType : uint8_t
+{
+  BB_FLOAT,
+  BB_INT,
+  BB_ENTITY,
+  BB_POSITION
+};
+
+struct BbVarDesc
+{
+  std::string name;
+  BbVarType type = BB_FLOAT;
+};
+
+// Immutable tree definition, built once and shared between all entities of an
+// archetype. Leaves refer to blackboard vars through bbVars, BehTreeBinding
+// maps them onto the slots of a blackboard schema.
+struct FlatBehaviourTree
+{
+  std::vector<FlatBehNode> nodes;
+  std::vector<utility_function> utilities; // nullptr where linearUtilities is used
+  std::vector<LinearUtility> linearUtilities; // used where curveUtilities has no considerations
+  std::vector<CurveUtility> curveUtilities;
+  std::vector<BbKey<float>> utilityInputs; // floats read by linear and curve utilities
+  std::vector<BbVarDesc> bbVars;
+  // resume from the running leaf instead of re-entering at the root each tick
+  bool resumeRunning = false;
+  // Only tick when something the conditions depend on changed or a leaf is
+  // running, a resumed running leaf only re-checks reactive guards then.
+  bool eventDriven = false;
+  uint8_t dependencies = 0;
+  float enemyRange = 0.f;
+};
+
+// Positions and teams of everything that can be targeted, taken at the start of
+// the turn from the spatial grid. Flat trees look enemies up here instead of
+// querying the world.
+struct BehWorldSnapshot
+{
+  const SpatialGrid *grid = nullptr;
+  std::unordered_map<flecs::entity_t, size_t> indices; // into grid entries
+
+  const Position *find(flecs::entity entity) const
+  {
+    const auto itf = indices.find(entity.id());
+    return itf == indices.end() ? nullptr : &grid->entries[itf->second].pos;
+  }
+};
+
+// Components of the ticked agent, read before the trees run. Leaves only write
+// the agent's own action and blackboard, so agents can be ticked on any thread.
+struct BehAgent
+{
+  flecs::entity entity;
+  Position pos;
+  int team = 0;
+  float hitpoints = 0.f;
+  Action *action = nullptr;
+};
+
+// Tree definition bound to the blackboard schema of an archetype. Blackboard
+// vars are resolved to slots once, so entities don't look names up at spawn.
+struct BehTreeBinding
+{
+  std::shared_ptr<const FlatBehaviourTree> tree;
+  std::shared_ptr<BlackboardSchema> schema;
+  std::vector<size_t> bbSlots; // FlatBehaviourTree::bbVars -> offsets in schema
+};
+
+struct BehaviourTreeState
+{
+  std::shared_ptr<const BehTreeBinding> binding;
+  // linear and curve utilities precomputed by batch_beh_tree_utilities for this
+  // tick, points into the batch, nullptr if not scored
+  const float *utilityScores = nullptr;
+  uint32_t runningNode = BEH_NO_NODE;
+  bool dirty = true;
+  uint32_t bbVersion = 0;
+  uint32_t randomState = 1; // per agent, so random walks don't depend on tick order
+
+  void update(const BehWorldSnapshot &world, const BehAgent &agent, Blackboard &bb);
+};
+
+FlatBehaviourTree flatten_beh_tree(const BehaviourTree &bt);
+std::shared_ptr<const BehTreeBinding> bind_beh_tree_schema(std::shared_ptr<const FlatBehaviourTree> tree,
+                                                           std::shared_ptr<BlackboardSchema> schema);
+// the entity's Blackboard has to use the schema of the binding
+BehaviourTreeState bind_beh_tree(std::shared_ptr<const BehTreeBinding> binding, flecs::entity entity);
+void batch_beh_tree_utilities(flecs::world &ecs);
+void register_beh_tree_observers(flecs::world &ecs);
+// Ticks all flat trees, spread over num_threads workers (0 - one per core).
+// Results don't depend on the number of threads. Reads the spatial grid, so
+// rebuild_spatial_grid has to be called earlier in the turn.
+void update_beh_trees(flecs::world &ecs, unsigned num_threads = 0);
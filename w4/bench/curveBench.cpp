@@ -0,0 +1,196 @@
+// Headless check and benchmark of utility scoring through response curves: every
+// curve is scored through a CurveUtility against its formula computed directly,
+// then batched scoring of a shared tree is timed and checked against inline scoring
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <flecs.h>
+#include "aiLibrary.h"
+#include "behaviourTree.h"
+#include "blackboard.h"
+#include "ecsTypes.h"
+#include "responseCurves.h"
+
+static const BbKey<float> inputBb("input");
+static const BbKey<float> hpBb("hp");
+static const BbKey<float> enemyDistBb("enemyDist");
+
+static float clamp01(float v)
+{
+  return v < 0.f ? 0.f : v > 1.f ? 1.f : v;
+}
+
+struct CurveCase
+{
+  const char *name;
+  ResponseCurve curve;
+  float (*formula)(float x);
+};
+
+// piecewise points sit on table entries, so its table is exact there
+static std::vector<CurveCase> create_curve_cases()
+{
+  return {
+    {"linear", linear_curve(-1.f, 1.f), [](float x) { return 1.f - x; }},
+    {"quadratic", quadratic_curve(2.f, -1.f, 1.f), [](float x) { return 1.f - x * x; }},
+    {"logistic", logistic_curve(-10.f, 0.4f), [](float x) { return 1.f / (1.f + expf(10.f * (x - 0.4f))); }},
+    {"piecewise", piecewise_curve({{0.f, 0.2f}, {0.25f, 1.f}, {1.f, 0.6f}}),
+      [](float x) { return x <= 0.25f ? 0.2f + 3.2f * x : 1.f - (x - 0.25f) * 0.4f / 0.75f; }}};
+}
+
+// direct form of the compensation described at CurveUtility
+static float compensated(float score, size_t num_considerations)
+{
+  return score + (1.f - score) * (1.f - 1.f / float(num_considerations)) * score;
+}
+
+static bool is_close(float value, float expected, float tolerance)
+{
+  return std::fabs(value - expected) <= tolerance;
+}
+
+// inputs outside the range are clamped, NaN scores as the range start
+static size_t check_curves()
+{
+  const std::vector<CurveCase> cases = create_curve_cases();
+  constexpr float minValue = -5.f;
+  constexpr float maxValue = 15.f;
+  constexpr float weight = 2.f;
+  constexpr float tolerance = 1e-3f;
+  Blackboard bb;
+  size_t failures = 0;
+  for (const CurveCase &curveCase : cases)
+  {
+    const CurveUtility utility{{Consideration{inputBb, minValue, maxValue, curveCase.curve}}, weight};
+    float maxErr = 0.f;
+    for (int step = 0; step <= 600; ++step)
+    {
+      const float value = step < 600 ? -10.f + float(step) * 0.05f : NAN;
+      bb.set(inputBb, value);
+      const float x = std::isnan(value) ? 0.f : clamp01((value - minValue) / (maxValue - minValue));
+      const float expected = weight * clamp01(curveCase.formula(x));
+      const float score = curve_utility_score(utility, bb);
+      maxErr = std::max(maxErr, std::fabs(score - expected));
+      failures += !is_close(score, expected, tolerance * weight);
+    }
+    printf("%10s curve max error %g\n", curveCase.name, double(maxErr));
+  }
+
+  // several considerations multiply their compensated scores
+  const CurveUtility fleeUtility{{Consideration{hpBb, 0.f, 100.f, cases[2].curve},
+                                  Consideration{enemyDistBb, 0.f, 10.f, cases[0].curve}}, 400.f};
+  for (int hp = 0; hp <= 100; hp += 5)
+    for (int enemyDist = 0; enemyDist <= 10; ++enemyDist)
+    {
+      bb.set(hpBb, float(hp));
+      bb.set(enemyDistBb, float(enemyDist));
+      const float expected = 400.f * compensated(clamp01(cases[2].formula(float(hp) / 100.f)), 2) *
+                             compensated(clamp01(cases[0].formula(float(enemyDist) / 10.f)), 2);
+      failures += !is_close(curve_utility_score(fleeUtility, bb), expected, tolerance * 400.f * 2.f);
+    }
+  return failures;
+}
+
+static std::shared_ptr<const FlatBehaviourTree> create_curve_beh_def()
+{
+  const std::vector<CurveCase> cases = create_curve_cases();
+  BehNode *root =
+    utility_selector({
+      std::make_pair(
+        sequence({
+          find_enemy(4.f, "flee_enemy"),
+          flee("flee_enemy")
+        }),
+        CurveUtility{{Consideration{hpBb, 0.f, 100.f, cases[2].curve},
+                      Consideration{enemyDistBb, 0.f, 10.f, cases[0].curve}}, 400.f}
+      ),
+      std::make_pair(
+        sequence({
+          find_enemy(3.f, "attack_enemy"),
+          move_to_entity("attack_enemy")
+        }),
+        CurveUtility{{Consideration{enemyDistBb, 0.f, 10.f, cases[1].curve}}, 100.f}
+      ),
+      std::make_pair(
+        patrol(2.f, "patrol_pos"),
+        CurveUtility{{Consideration{hpBb, 0.f, 100.f, cases[3].curve}}, 100.f}
+      )
+    });
+  return std::make_shared<const FlatBehaviourTree>(flatten_beh_tree(BehaviourTree{root}));
+}
+
+int main(int argc, const char **argv)
+{
+  const size_t numAgents = argc > 1 ? size_t(std::atoi(argv[1])) : 100000;
+  const uint32_t numTurns = argc > 2 ? uint32_t(std::atoi(argv[2])) : 20;
+
+  const size_t curveFailures = check_curves();
+  printf("curve scores off their formulas: %zu\n", curveFailures);
+
+  flecs::world ecs;
+  const std::shared_ptr<BlackboardSchema> schema = std::make_shared<BlackboardSchema>();
+  const std::shared_ptr<const BehTreeBinding> binding = bind_beh_tree_schema(create_curve_beh_def(), schema);
+  const std::vector<CurveUtility> &utilities = binding->tree->curveUtilities;
+  std::vector<flecs::entity> agents;
+  agents.reserve(numAgents);
+  for (size_t i = 0; i < numAgents; ++i)
+  {
+    flecs::entity e = ecs.entity()
+      .set(Position{int(i % 1000), int(i / 1000)})
+      .set(Blackboard{schema});
+    e.set(bind_beh_tree(binding, e));
+    agents.push_back(e);
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> hpDist(-10.f, 110.f);
+  std::uniform_real_distribution<float> enemyDistDist(0.f, 12.f);
+  double batchedMs = 0.0;
+  double inlineMs = 0.0;
+  size_t mismatches = 0;
+  float sink = 0.f;
+  for (uint32_t turn = 0; turn < numTurns; ++turn)
+  {
+    for (flecs::entity e : agents)
+    {
+      Blackboard &bb = *e.get_mut<Blackboard>();
+      bb.set(hpBb, hpDist(rng));
+      bb.set(enemyDistBb, enemyDistDist(rng));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    batch_beh_tree_utilities(ecs);
+    auto mid = std::chrono::steady_clock::now();
+    for (flecs::entity e : agents)
+    {
+      const Blackboard &bb = *e.get<Blackboard>();
+      for (const CurveUtility &utility : utilities)
+        sink += curve_utility_score(utility, bb);
+    }
+    auto end = std::chrono::steady_clock::now();
+    batchedMs += std::chrono::duration<double, std::milli>(mid - start).count();
+    inlineMs += std::chrono::duration<double, std::milli>(end - mid).count();
+
+    for (flecs::entity e : agents)
+    {
+      const BehaviourTreeState &state = *e.get<BehaviourTreeState>();
+      const Blackboard &bb = *e.get<Blackboard>();
+      for (size_t u = 0; u < utilities.size(); ++u)
+      {
+        const float expected = curve_utility_score(utilities[u], bb);
+        mismatches += !state.utilityScores || !is_close(state.utilityScores[u], expected, 1e-5f * (1.f + std::fabs(expected)));
+      }
+    }
+  }
+  printf("%zu agents, %u turns, values are per turn averages\n", numAgents, numTurns);
+  printf("%10s %12s\n", "scoring", "time(ms)");
+  printf("%10s %12.3f\n", "batched", batchedMs / double(numTurns));
+  printf("%10s %12.3f\n", "inline", inlineMs / double(numTurns));
+  printf("batched scores off inline ones: %zu (checksum %g)\n", mismatches, double(sink));
+  return curveFailures == 0 && mismatches == 0 ? 0 : 1;
+}
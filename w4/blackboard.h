@@ -1,71 +1,141 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 #include <flecs.h>
 #include "ecsTypes.h"
 
+// Names are interned once per data type, keys and schemas refer to them by id.
 template<typename DataType>
-class NamedDataPool
+size_t intern_bb_name(const std::string &name)
+{
+  static std::unordered_map<std::string, size_t> nameIndices;
+  const auto itf = nameIndices.find(name);
+  if (itf != nameIndices.end())
+    return itf->second;
+
+  size_t idx = nameIndices.size();
+  nameIndices.emplace(name, idx);
+  return idx;
+}
+
+// Typed key resolved once at startup, get/set through it is an array index.
+template<typename DataType>
+struct BbKey
+{
+  size_t idx = size_t(-1);
+  explicit BbKey(const char *name) : idx(intern_bb_name<DataType>(name)) {}
+};
+
+template<typename DataType>
+struct SchemaOffsets
+{
+  std::vector<size_t> offsets; // interned name id -> offset in the value block
+};
+
+// Layout of blackboard values, shared by all entities of an archetype. Names
+// are only ever appended, so offsets stay valid for every blackboard using it.
+class BlackboardSchema : SchemaOffsets<float>,
+                         SchemaOffsets<int>,
+                         SchemaOffsets<flecs::entity>,
+                         SchemaOffsets<Position>
 {
 public:
-  size_t regName(const std::string &name)
-  {
-    const auto itf = nameIndices.find(name);
-    if (itf != nameIndices.end())
-      return itf->second;
-
-    size_t idx = data.size();
-    nameIndices.emplace(name, idx);
-    data.emplace_back(DataType());
-    return idx;
-  }
+  static constexpr size_t no_offset = size_t(-1);
 
-  void set(size_t idx, const DataType &in_data)
+  template<typename DataType>
+  size_t regName(size_t name_idx)
   {
-    data[idx] = in_data;
+    std::vector<size_t> &offsets = SchemaOffsets<DataType>::offsets;
+    if (name_idx >= offsets.size())
+      offsets.resize(name_idx + 1, no_offset);
+    if (offsets[name_idx] == no_offset)
+    {
+      blockSize = (blockSize + alignof(DataType) - 1) / alignof(DataType) * alignof(DataType);
+      offsets[name_idx] = blockSize;
+      blockSize += sizeof(DataType);
+    }
+    return offsets[name_idx];
   }
 
-  DataType get(size_t idx) const
+  template<typename DataType>
+  size_t offset(size_t name_idx) const
   {
-    return data[idx];
+    const std::vector<size_t> &offsets = SchemaOffsets<DataType>::offsets;
+    return name_idx < offsets.size() ? offsets[name_idx] : no_offset;
   }
+
+  size_t size() const { return blockSize; }
 private:
-  std::unordered_map<std::string, size_t> nameIndices;
-  std::vector<DataType> data;
+  size_t blockSize = 0;
 };
 
-class Blackboard : public NamedDataPool<float>,
-                   public NamedDataPool<int>,
-                   public NamedDataPool<flecs::entity>,
-                   public NamedDataPool<Position>
+// Slot ids returned by regName are offsets into a single value block laid out
+// by the (possibly shared) schema.
+class Blackboard
 {
 public:
+  Blackboard() : schema(std::make_shared<BlackboardSchema>()) {}
+  explicit Blackboard(std::shared_ptr<BlackboardSchema> in_schema) : schema(std::move(in_schema)) {}
+
   template<typename DataType>
   size_t regName(const std::string &name)
   {
-    return NamedDataPool<DataType>::regName(name);
+    return schema->regName<DataType>(intern_bb_name<DataType>(name));
   }
 
   template<typename DataType>
   void set(size_t idx, const DataType &in_data)
   {
-    NamedDataPool<DataType>::set(idx, in_data);
+    static_assert(std::is_trivially_copyable_v<DataType>);
+    if (idx + sizeof(DataType) > values.size())
+      values.resize(schema->size());
+    if (memcmp(values.data() + idx, &in_data, sizeof(DataType)) == 0)
+      return;
+    memcpy(values.data() + idx, &in_data, sizeof(DataType));
+    ++version;
   }
 
   template<typename DataType>
   DataType get(size_t idx) const
   {
-    return NamedDataPool<DataType>::get(idx);
+    static_assert(std::is_trivially_copyable_v<DataType>);
+    DataType res{};
+    if (idx + sizeof(DataType) <= values.size())
+      memcpy(&res, values.data() + idx, sizeof(DataType));
+    return res;
+  }
+
+  template<typename DataType>
+  void set(BbKey<DataType> key, const DataType &in_data)
+  {
+    set<DataType>(schema->regName<DataType>(key.idx), in_data);
   }
 
-  // not perf optimized
+  template<typename DataType>
+  DataType get(BbKey<DataType> key) const
+  {
+    const size_t idx = schema->offset<DataType>(key.idx);
+    return idx == BlackboardSchema::no_offset ? DataType() : get<DataType>(idx);
+  }
+
+  // bumped by every write that changes a value
+  uint32_t getVersion() const { return version; }
+  const BlackboardSchema *getSchema() const { return schema.get(); }
+
+  // not perf optimized, for debugging only, use BbKey on hot paths
   template<typename DataType>
   DataType get(const char *name)
   {
-    size_t idx = regName<DataType>(name);
-    return NamedDataPool<DataType>::get(idx);
+    return get(BbKey<DataType>(name));
   }
+private:
+  std::shared_ptr<BlackboardSchema> schema;
+  std::vector<unsigned char> values;
+  uint32_t version = 0;
 };
-
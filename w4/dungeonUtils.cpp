@@ -27,11 +27,21 @@ bool dungeon::is_tile_walkable(flecs::world &ecs, Position pos)
   bool res = false;
   dungeonDataQuery.each([&](const DungeonData &dd)
   {
-    if (pos.x < 0 || pos.x >= int(dd.width) ||
-        pos.y < 0 || pos.y >= int(dd.height))
-      return;
-    res = dd.tiles[size_t(pos.y) * dd.width + size_t(pos.x)] == dungeon::floor;
+    res = is_tile_walkable(dd, pos);
   });
   return res;
 }
 
+bool dungeon::is_tile_walkable(const DungeonData &dd, Position pos)
+{
+  const int idx = tile_idx(dd, pos);
+  return idx >= 0 && dd.tiles[size_t(idx)] == dungeon::floor;
+}
+
+int dungeon::tile_idx(const DungeonData &dd, Position pos)
+{
+  if (pos.x < 0 || pos.x >= int(dd.width) ||
+      pos.y < 0 || pos.y >= int(dd.height))
+    return -1;
+  return int(size_t(pos.y) * dd.width + size_t(pos.x));
+}
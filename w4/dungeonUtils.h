@@ -2,6 +2,23 @@
 #include "ecsTypes.h"
 #include <flecs.h>
 
+// Characters (MovePos, Hitpoints and Team) by the tile of their MovePos. Lives
+// on the dungeon entity next to DungeonData, process_actions rebuilds it each
+// turn and keeps it up to date as moves are committed.
+struct TileOccupancy
+{
+  struct Occupant
+  {
+    flecs::entity entity;
+    Hitpoints *hitpoints = nullptr;
+    int team = 0;
+    int next = -1; // next occupant of the same tile
+  };
+  std::vector<int> firstAt; // per tile, -1 if it is free
+  std::vector<Occupant> occupants;
+  std::unordered_map<flecs::entity_t, int> indices;
+};
+
 namespace dungeon
 {
   constexpr char wall = '#';
@@ -9,4 +26,7 @@ namespace dungeon
 
   Position find_walkable_tile(flecs::world &ecs);
   bool is_tile_walkable(flecs::world &ecs, Position pos);
+  bool is_tile_walkable(const DungeonData &dd, Position pos);
+  // index into DungeonData::tiles, -1 outside of the dungeon
+  int tile_idx(const DungeonData &dd, Position pos);
 };
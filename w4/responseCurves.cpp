@@ -0,0 +1,61 @@
+#include "responseCurves.h"
+#include <cmath>
+
+template<typename Callable>
+static ResponseCurve sample_curve(Callable c)
+{
+  ResponseCurve curve;
+  for (size_t i = 0; i <= ResponseCurve::lut_size; ++i)
+  {
+    const float y = c(float(i) / float(ResponseCurve::lut_size));
+    curve.lut[i] = y < 0.f ? 0.f : y > 1.f ? 1.f : y;
+  }
+  return curve;
+}
+
+ResponseCurve linear_curve(float slope, float intercept)
+{
+  return sample_curve([&](float x) { return slope * x + intercept; });
+}
+
+ResponseCurve quadratic_curve(float exponent, float slope, float intercept)
+{
+  return sample_curve([&](float x) { return slope * powf(x, exponent) + intercept; });
+}
+
+ResponseCurve logistic_curve(float steepness, float midpoint)
+{
+  return sample_curve([&](float x) { return 1.f / (1.f + expf(-steepness * (x - midpoint))); });
+}
+
+ResponseCurve piecewise_curve(const std::vector<std::pair<float, float>> &points)
+{
+  return sample_curve([&](float x)
+  {
+    if (points.empty())
+      return 0.f;
+    if (x <= points.front().first)
+      return points.front().second;
+    for (size_t i = 1; i < points.size(); ++i)
+    {
+      if (x > points[i].first)
+        continue;
+      const std::pair<float, float> &from = points[i - 1];
+      const std::pair<float, float> &to = points[i];
+      const float t = (x - from.first) / (to.first - from.first);
+      return from.second + (to.second - from.second) * t;
+    }
+    return points.back().second;
+  });
+}
+
+float curve_utility_score(const CurveUtility &utility, const Blackboard &bb)
+{
+  float score = utility.weight;
+  for (const Consideration &consideration : utility.considerations)
+  {
+    const float considerationScore = consideration.score(bb.get(consideration.input));
+    score *= compensate_consideration(considerationScore, utility.considerations.size());
+  }
+  return score;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include "blackboard.h"
+
+// Response curve over an input normalized to [0, 1]. The curve is sampled into
+// a lookup table when it is built, so scoring never calls expf/powf.
+struct ResponseCurve
+{
+  static constexpr size_t lut_size = 64;
+  float lut[lut_size + 1] = {};
+
+  float sample(float x) const
+  {
+    // also catches NaN, which must not reach the cast below
+    if (!(x > 0.f))
+      return lut[0];
+    if (x >= 1.f)
+      return lut[lut_size];
+    const float pos = x * float(lut_size);
+    const size_t idx = size_t(pos);
+    if (idx >= lut_size)
+      return lut[lut_size];
+    const float t = pos - float(idx);
+    return lut[idx] + (lut[idx + 1] - lut[idx]) * t;
+  }
+};
+
+// all curves are clamped to [0, 1]
+ResponseCurve linear_curve(float slope = 1.f, float intercept = 0.f);
+ResponseCurve quadratic_curve(float exponent = 2.f, float slope = 1.f, float intercept = 0.f);
+ResponseCurve logistic_curve(float steepness = 10.f, float midpoint = 0.5f);
+ResponseCurve piecewise_curve(const std::vector<std::pair<float, float>> &points); // sorted by x
+
+// Maps a blackboard float from [minValue, maxValue] onto [0, 1] through a curve.
+struct Consideration
+{
+  BbKey<float> input;
+  float minValue = 0.f;
+  float maxValue = 1.f;
+  ResponseCurve curve;
+
+  float score(float value) const
+  {
+    // an empty range is a step at minValue
+    if (maxValue == minValue)
+      return curve.sample(value < minValue ? 0.f : 1.f);
+    return curve.sample((value - minValue) / (maxValue - minValue));
+  }
+};
+
+// Considerations are multiplied together. Each is first compensated for the
+// number of considerations, so adding more of them does not drag the product
+// towards zero. The product is scaled by weight.
+struct CurveUtility
+{
+  std::vector<Consideration> considerations;
+  float weight = 1.f;
+};
+
+inline float compensate_consideration(float score, size_t num_considerations)
+{
+  const float modification = 1.f - 1.f / float(num_considerations);
+  return score + (1.f - score) * modification * score;
+}
+
+float curve_utility_score(const CurveUtility &utility, const Blackboard &bb);
@@ -9,6 +9,7 @@
 #include "dijkstraMapGen.h"
 #include "dmapFollower.h"
 #include "aiUtils.h"
+#include "spatialGrid.h"
 
 static flecs::entity create_player_approacher(flecs::entity e)
 {
@@ -41,71 +42,84 @@ static flecs::entity create_hive(flecs::entity e)
 }
 
 
-static void create_fuzzy_monster_beh(flecs::entity e)
+// blackboard keys filled by gather_world_info
+static const BbKey<float> hpBb("hp");
+static const BbKey<float> enemyDistBb("enemyDist");
+static const BbKey<float> alliesNumBb("alliesNum");
+
+static std::shared_ptr<const FlatBehaviourTree> create_fuzzy_monster_beh_def()
 {
-  e.set(Blackboard{});
+  // linear utilities so all fuzzy monsters are scored in one batch
   BehNode *root =
     utility_selector({
       std::make_pair(
         sequence({
-          find_enemy(e, 4.f, "flee_enemy"),
-          flee(e, "flee_enemy")
+          find_enemy(4.f, "flee_enemy"),
+          flee("flee_enemy")
         }),
-        [](Blackboard &bb)
-        {
-          const float hp = bb.get<float>("hp");
-          const float enemyDist = bb.get<float>("enemyDist");
-          return (100.f - hp) * 5.f - 50.f * enemyDist;
-        }
+        LinearUtility{500.f, {{hpBb, -5.f}, {enemyDistBb, -50.f}}} // (100 - hp) * 5 - 50 * enemyDist
       ),
       std::make_pair(
         sequence({
-          find_enemy(e, 3.f, "attack_enemy"),
-          move_to_entity(e, "attack_enemy")
+          find_enemy(3.f, "attack_enemy"),
+          move_to_entity("attack_enemy")
         }),
-        [](Blackboard &bb)
-        {
-          const float enemyDist = bb.get<float>("enemyDist");
-          return 100.f - 10.f * enemyDist;
-        }
+        LinearUtility{100.f, {{enemyDistBb, -10.f}}}
       ),
       std::make_pair(
-        patrol(e, 2.f, "patrol_pos"),
-        [](Blackboard &)
-        {
-          return 50.f;
-        }
+        patrol(2.f, "patrol_pos"),
+        LinearUtility{50.f, {}}
       ),
       std::make_pair(
         patch_up(100.f),
-        [](Blackboard &bb)
-        {
-          const float hp = bb.get<float>("hp");
-          return 140.f - hp;
-        }
+        LinearUtility{140.f, {{hpBb, -1.f}}}
       )
     });
-  e.add<WorldInfoGatherer>();
-  e.set(BehaviourTree{root});
+  return std::make_shared<const FlatBehaviourTree>(flatten_beh_tree(BehaviourTree{root}));
 }
 
-static void create_minotaur_beh(flecs::entity e)
+static std::shared_ptr<const FlatBehaviourTree> create_minotaur_beh_def()
 {
-  e.set(Blackboard{});
   BehNode *root =
     selector({
-      sequence({
-        is_low_hp(50.f),
-        find_enemy(e, 4.f, "flee_enemy"),
-        flee(e, "flee_enemy")
-      }),
-      sequence({
-        find_enemy(e, 3.f, "attack_enemy"),
-        move_to_entity(e, "attack_enemy")
-      }),
-      patrol(e, 2.f, "patrol_pos")
+      reactive(sequence({
+        reactive(is_low_hp(50.f)),
+        find_enemy(4.f, "flee_enemy"),
+        flee("flee_enemy")
+      })),
+      reactive(sequence({
+        find_enemy(3.f, "attack_enemy"),
+        move_to_entity("attack_enemy")
+      })),
+      patrol(2.f, "patrol_pos")
     });
-  e.set(BehaviourTree{root});
+  // keeps chasing or fleeing from the same enemy, only low hp and new enemies
+  // interrupt, and guards are only re-checked after hp or nearby enemies changed
+  FlatBehaviourTree tree = flatten_beh_tree(BehaviourTree{root});
+  tree.resumeRunning = true;
+  tree.eventDriven = true;
+  return std::make_shared<const FlatBehaviourTree>(std::move(tree));
+}
+
+// tree definitions, blackboard layouts and the slots binding one to the other
+// are built once and shared, entities only keep their state and blackboard values
+static void create_fuzzy_monster_beh(flecs::entity e)
+{
+  static const std::shared_ptr<BlackboardSchema> fuzzyMonsterBbSchema = std::make_shared<BlackboardSchema>();
+  static const std::shared_ptr<const BehTreeBinding> fuzzyMonsterBeh =
+    bind_beh_tree_schema(create_fuzzy_monster_beh_def(), fuzzyMonsterBbSchema);
+  e.set(Blackboard{fuzzyMonsterBbSchema});
+  e.add<WorldInfoGatherer>();
+  e.set(bind_beh_tree(fuzzyMonsterBeh, e));
+}
+
+static void create_minotaur_beh(flecs::entity e)
+{
+  static const std::shared_ptr<BlackboardSchema> minotaurBbSchema = std::make_shared<BlackboardSchema>();
+  static const std::shared_ptr<const BehTreeBinding> minotaurBeh =
+    bind_beh_tree_schema(create_minotaur_beh_def(), minotaurBbSchema);
+  e.set(Blackboard{minotaurBbSchema});
+  e.set(bind_beh_tree(minotaurBeh, e));
 }
 
 static Position find_free_dungeon_tile(flecs::world &ecs)
@@ -129,6 +143,7 @@ static Position find_free_dungeon_tile(flecs::world &ecs)
 
 static flecs::entity create_monster(flecs::world &ecs, Color col, const char *texture_src)
 {
+  static const std::shared_ptr<BlackboardSchema> monsterBbSchema = std::make_shared<BlackboardSchema>();
   Position pos = find_free_dungeon_tile(ecs);
 
   flecs::entity textureSrc = ecs.entity(texture_src);
@@ -143,7 +158,7 @@ static flecs::entity create_monster(flecs::world &ecs, Color col, const char *te
     .set(Team{1})
     .set(NumActions{1, 0})
     .set(MeleeDamage{20.f})
-    .set(Blackboard{});
+    .set(Blackboard{monsterBbSchema});
 }
 
 static void create_player(flecs::world &ecs, const char *texture_src)
@@ -331,6 +346,7 @@ static void register_roguelike_systems(flecs::world &ecs)
 void init_roguelike(flecs::world &ecs)
 {
   register_roguelike_systems(ecs);
+  register_beh_tree_observers(ecs);
 
   ecs.entity("swordsman_tex")
     .set(Texture2D{LoadTexture("assets/swordsman.png")});
@@ -371,7 +387,8 @@ void init_dungeon(flecs::world &ecs, char *tiles, size_t w, size_t h)
     for (size_t x = 0; x < w; ++x)
       dungeonData[y * w + x] = tiles[y * w + x];
   ecs.entity("dungeon")
-    .set(DungeonData{dungeonData, w, h});
+    .set(DungeonData{dungeonData, w, h})
+    .set(TileOccupancy{});
 
   for (size_t y = 0; y < h; ++y)
     for (size_t x = 0; x < w; ++x)
@@ -423,49 +440,108 @@ static void push_to_log(flecs::world &ecs, const char *msg)
   });
 }
 
+static void rebuild_tile_occupancy(flecs::world &ecs, const DungeonData &dd, TileOccupancy &occupancy)
+{
+  static auto occupantsQuery = ecs.query<const MovePos, Hitpoints, const Team>();
+  occupancy.firstAt.assign(dd.tiles.size(), -1);
+  occupancy.occupants.clear();
+  occupancy.indices.clear();
+  std::vector<int> tiles;
+  occupantsQuery.each([&](flecs::entity entity, const MovePos &mpos, Hitpoints &hp, const Team &team)
+  {
+    occupancy.indices.emplace(entity.id(), int(occupancy.occupants.size()));
+    occupancy.occupants.push_back(TileOccupancy::Occupant{entity, &hp, team.team, -1});
+    tiles.push_back(dungeon::tile_idx(dd, Position{mpos.x, mpos.y}));
+  });
+  // linked backwards so occupants of a tile keep the query order
+  for (int i = int(occupancy.occupants.size()) - 1; i >= 0; --i)
+    if (tiles[size_t(i)] >= 0)
+    {
+      occupancy.occupants[size_t(i)].next = occupancy.firstAt[size_t(tiles[size_t(i)])];
+      occupancy.firstAt[size_t(tiles[size_t(i)])] = i;
+    }
+}
+
+static void move_occupant(const DungeonData &dd, TileOccupancy &occupancy, flecs::entity entity,
+                          Position from, Position to)
+{
+  const auto itf = occupancy.indices.find(entity.id());
+  if (itf == occupancy.indices.end())
+    return;
+  const int idx = itf->second;
+  const int fromTile = dungeon::tile_idx(dd, from);
+  if (fromTile >= 0)
+    for (int *link = &occupancy.firstAt[size_t(fromTile)]; *link >= 0; link = &occupancy.occupants[size_t(*link)].next)
+      if (*link == idx)
+      {
+        *link = occupancy.occupants[size_t(idx)].next;
+        break;
+      }
+  occupancy.occupants[size_t(idx)].next = -1;
+  const int toTile = dungeon::tile_idx(dd, to);
+  if (toTile >= 0)
+  {
+    occupancy.occupants[size_t(idx)].next = occupancy.firstAt[size_t(toTile)];
+    occupancy.firstAt[size_t(toTile)] = idx;
+  }
+}
+
 static void process_actions(flecs::world &ecs)
 {
   static auto processActions = ecs.query<Action, Position, MovePos, const MeleeDamage, const Team>();
   static auto processHeals = ecs.query<Action, Hitpoints>();
-  static auto checkAttacks = ecs.query<const MovePos, Hitpoints, const Team>();
+  static auto dungeonOccupancy = ecs.query<const DungeonData, TileOccupancy>();
   // Process all actions
   ecs.defer([&]
   {
-    processHeals.each([&](Action &a, Hitpoints &hp)
+    processHeals.each([&](flecs::entity entity, Action &a, Hitpoints &hp)
     {
       if (a.action != EA_HEAL_SELF)
         return;
       a.action = EA_NOP;
       push_to_log(ecs, "Monster healed itself");
       hp.hitpoints += 10.f;
+      entity.modified<Hitpoints>();
 
     });
-    processActions.each([&](flecs::entity entity, Action &a, Position &pos, MovePos &mpos, const MeleeDamage &dmg, const Team &team)
+    dungeonOccupancy.each([&](const DungeonData &dd, TileOccupancy &occupancy)
     {
-      Position nextPos = move_pos(pos, a.action);
-      bool blocked = !dungeon::is_tile_walkable(ecs, nextPos);
-      checkAttacks.each([&](flecs::entity enemy, const MovePos &epos, Hitpoints &hp, const Team &enemy_team)
+      rebuild_tile_occupancy(ecs, dd, occupancy);
+      processActions.each([&](flecs::entity entity, Action &a, Position &pos, MovePos &mpos, const MeleeDamage &dmg, const Team &team)
       {
-        if (entity != enemy && epos == nextPos)
+        Position nextPos = move_pos(pos, a.action);
+        bool blocked = !dungeon::is_tile_walkable(dd, nextPos);
+        const int tile = dungeon::tile_idx(dd, nextPos);
+        for (int i = tile >= 0 ? occupancy.firstAt[size_t(tile)] : -1; i >= 0; i = occupancy.occupants[size_t(i)].next)
         {
+          const TileOccupancy::Occupant &enemy = occupancy.occupants[size_t(i)];
+          if (entity == enemy.entity)
+            continue;
           blocked = true;
-          if (team.team != enemy_team.team)
+          if (team.team != enemy.team)
           {
             push_to_log(ecs, "damaged entity");
-            hp.hitpoints -= dmg.damage;
+            enemy.hitpoints->hitpoints -= dmg.damage;
+            enemy.entity.modified<Hitpoints>();
           }
         }
+        if (blocked)
+          a.action = EA_NOP;
+        else
+        {
+          move_occupant(dd, occupancy, entity, Position{mpos.x, mpos.y}, nextPos);
+          mpos = nextPos;
+        }
       });
-      if (blocked)
-        a.action = EA_NOP;
-      else
-        mpos = nextPos;
     });
     // now move
-    processActions.each([&](Action &a, Position &pos, MovePos &mpos, const MeleeDamage &, const Team&)
+    processActions.each([&](flecs::entity entity, Action &a, Position &pos, MovePos &mpos, const MeleeDamage &, const Team&)
     {
+      const bool moved = !(pos == mpos);
       pos = mpos;
       a.action = EA_NOP;
+      if (moved)
+        entity.modified<Position>();
     });
   });
 
@@ -507,10 +583,9 @@ static void process_actions(flecs::world &ecs)
 }
 
 template<typename T>
-static void push_info_to_bb(Blackboard &bb, const char *name, const T &val)
+static void push_info_to_bb(Blackboard &bb, BbKey<T> key, const T &val)
 {
-  size_t idx = bb.regName<T>(name);
-  bb.set(idx, val);
+  bb.set(key, val);
 }
 
 // sensors
@@ -520,28 +595,19 @@ static void gather_world_info(flecs::world &ecs)
                                           const Position, const Hitpoints,
                                           const WorldInfoGatherer,
                                           const Team>();
-  static auto alliesQuery = ecs.query<const Position, const Team>();
-  gatherWorldInfo.each([&](Blackboard &bb, const Position &pos, const Hitpoints &hp,
-                           WorldInfoGatherer, const Team &team)
+  query_spatial_grid(ecs, [&](const SpatialGrid &grid)
   {
-    // first gather all needed names (without cache)
-    push_info_to_bb(bb, "hp", hp.hitpoints);
-    float numAllies = 0; // note float
-    float closestEnemyDist = 100.f;
-    alliesQuery.each([&](const Position &apos, const Team &ateam)
+    gatherWorldInfo.each([&](Blackboard &bb, const Position &pos, const Hitpoints &hp,
+                             WorldInfoGatherer, const Team &team)
     {
+      push_info_to_bb(bb, hpBb, hp.hitpoints);
       constexpr float limitDist = 5.f;
-      if (team.team == ateam.team && dist_sq(pos, apos) < sqr(limitDist))
-        numAllies += 1.f;
-      if (team.team != ateam.team)
-      {
-        const float enemyDist = dist(pos, apos);
-        if (enemyDist < closestEnemyDist)
-          closestEnemyDist = enemyDist;
-      }
+      const float numAllies = float(count_in_radius(grid, pos, limitDist, team.team)); // note float
+      constexpr float maxEnemyDist = 100.f;
+      const SpatialGrid::Entry *enemy = nearest_enemy(grid, pos, team.team, maxEnemyDist);
+      push_info_to_bb(bb, alliesNumBb, numAllies);
+      push_info_to_bb(bb, enemyDistBb, enemy ? dist(pos, enemy->pos) : maxEnemyDist);
     });
-    push_info_to_bb(bb, "alliesNum", numAllies);
-    push_info_to_bb(bb, "enemyDist", closestEnemyDist);
   });
 }
 
@@ -556,7 +622,12 @@ void process_turn(flecs::world &ecs)
     if (upd_player_actions_count(ecs))
     {
       // Plan action for NPCs
+      rebuild_spatial_grid(ecs);
       gather_world_info(ecs);
+      batch_beh_tree_utilities(ecs);
+      // flat trees only read a snapshot and write actions in place, they are
+      // ticked on worker threads outside of the deferred block
+      update_beh_trees(ecs);
       ecs.defer([&]
       {
         stateMachineAct.each([&](flecs::entity e, StateMachine &sm)
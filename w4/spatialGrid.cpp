@@ -0,0 +1,122 @@
+#include "spatialGrid.h"
+#include <climits>
+#include <cstdlib>
+#include "math.h"
+
+static int cell_coord(int v, int origin)
+{
+  // floor division, positions asked about may lie outside of the grid
+  const int d = v - origin;
+  return d >= 0 ? d / SpatialGrid::cellSize : -((-d + SpatialGrid::cellSize - 1) / SpatialGrid::cellSize);
+}
+
+void rebuild_spatial_grid(flecs::world &ecs)
+{
+  static auto charactersQuery = ecs.query<const Position, const Team>();
+
+  SpatialGrid &grid = *ecs.entity("spatial_grid").get_mut<SpatialGrid>();
+  grid.entries.clear();
+  int minX = INT_MAX, minY = INT_MAX, maxX = INT_MIN, maxY = INT_MIN;
+  charactersQuery.each([&](flecs::entity e, const Position &pos, const Team &team)
+  {
+    grid.entries.push_back(SpatialGrid::Entry{e, pos, team.team});
+    minX = std::min(minX, pos.x);
+    minY = std::min(minY, pos.y);
+    maxX = std::max(maxX, pos.x);
+    maxY = std::max(maxY, pos.y);
+  });
+  if (grid.entries.empty())
+  {
+    grid.width = grid.height = 0;
+    grid.cellStart.clear();
+    grid.cellEntries.clear();
+    return;
+  }
+  grid.originX = minX;
+  grid.originY = minY;
+  grid.width = (maxX - minX) / SpatialGrid::cellSize + 1;
+  grid.height = (maxY - minY) / SpatialGrid::cellSize + 1;
+
+  // counting sort of entries by cell
+  grid.cellStart.assign(size_t(grid.width * grid.height) + 1, 0);
+  auto cellOf = [&](const Position &pos)
+  {
+    return size_t(cell_coord(pos.y, grid.originY) * grid.width + cell_coord(pos.x, grid.originX));
+  };
+  for (const SpatialGrid::Entry &entry : grid.entries)
+    grid.cellStart[cellOf(entry.pos) + 1]++;
+  for (size_t i = 1; i < grid.cellStart.size(); ++i)
+    grid.cellStart[i] += grid.cellStart[i - 1];
+  grid.cellEntries.resize(grid.entries.size());
+  std::vector<uint32_t> fill(grid.cellStart.begin(), grid.cellStart.end() - 1);
+  for (size_t i = 0; i < grid.entries.size(); ++i)
+    grid.cellEntries[fill[cellOf(grid.entries[i].pos)]++] = uint32_t(i);
+}
+
+const SpatialGrid::Entry *nearest_enemy(const SpatialGrid &grid, const Position &pos, int team, float max_dist)
+{
+  if (grid.entries.empty())
+    return nullptr;
+  const int cx = cell_coord(pos.x, grid.originX);
+  const int cy = cell_coord(pos.y, grid.originY);
+  const int maxRing = std::max(std::max(std::abs(cx), std::abs(grid.width - 1 - cx)),
+                               std::max(std::abs(cy), std::abs(grid.height - 1 - cy)));
+  uint32_t bestIdx = uint32_t(grid.entries.size());
+  float bestDist = FLT_MAX;
+  auto visitCell = [&](int x, int y)
+  {
+    if (x < 0 || y < 0 || x >= grid.width || y >= grid.height)
+      return;
+    const size_t cell = size_t(y * grid.width + x);
+    for (uint32_t i = grid.cellStart[cell]; i < grid.cellStart[cell + 1]; ++i)
+    {
+      const uint32_t idx = grid.cellEntries[i];
+      const SpatialGrid::Entry &entry = grid.entries[idx];
+      if (entry.team == team)
+        continue;
+      const float curDist = dist(entry.pos, pos);
+      if (curDist < bestDist || (curDist == bestDist && idx < bestIdx))
+      {
+        bestDist = curDist;
+        bestIdx = idx;
+      }
+    }
+  };
+  // rings of cells around the one pos is in, everything in ring r is more
+  // than (r - 1) * cellSize away
+  for (int ring = 0; ring <= maxRing; ++ring)
+  {
+    const float ringDist = float(std::max(0, ring - 1) * SpatialGrid::cellSize);
+    if (ringDist > max_dist || ringDist > bestDist)
+      break;
+    if (ring == 0)
+    {
+      visitCell(cx, cy);
+      continue;
+    }
+    for (int x = cx - ring; x <= cx + ring; ++x)
+    {
+      visitCell(x, cy - ring);
+      visitCell(x, cy + ring);
+    }
+    for (int y = cy - ring + 1; y <= cy + ring - 1; ++y)
+    {
+      visitCell(cx - ring, y);
+      visitCell(cx + ring, y);
+    }
+  }
+  if (bestIdx == grid.entries.size() || bestDist > max_dist)
+    return nullptr;
+  return &grid.entries[bestIdx];
+}
+
+int count_in_radius(const SpatialGrid &grid, const Position &pos, float radius, int team)
+{
+  int count = 0;
+  for_each_in_radius(grid, pos, radius, [&](const SpatialGrid::Entry &entry)
+  {
+    if (entry.team == team)
+      ++count;
+  });
+  return count;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+#include <flecs.h>
+#include "ecsTypes.h"
+#include "math.h"
+
+// All Position+Team entities bucketed by square cells. It is rebuilt once per
+// turn before NPCs plan, nothing moves until the actions are processed.
+struct SpatialGrid
+{
+  struct Entry
+  {
+    flecs::entity entity;
+    Position pos;
+    int team = 0;
+  };
+
+  static constexpr int cellSize = 8;
+
+  std::vector<Entry> entries; // in query order, it breaks distance ties
+  std::vector<uint32_t> cellEntries; // indices into entries sorted by cell
+  std::vector<uint32_t> cellStart; // per cell offset into cellEntries, one extra at the end
+  int originX = 0;
+  int originY = 0;
+  int width = 0;
+  int height = 0;
+};
+
+void rebuild_spatial_grid(flecs::world &ecs);
+
+// Closest entity of another team no further than max_dist, the first one in
+// query order if several are as close. nullptr if there is none.
+const SpatialGrid::Entry *nearest_enemy(const SpatialGrid &grid, const Position &pos, int team,
+                                        float max_dist = FLT_MAX);
+// entities of the team strictly closer than radius
+int count_in_radius(const SpatialGrid &grid, const Position &pos, float radius, int team);
+
+// Calls c for every entry strictly closer than radius, in no particular order.
+template<typename Callable>
+inline void for_each_in_radius(const SpatialGrid &grid, const Position &pos, float radius, Callable c)
+{
+  if (grid.entries.empty())
+    return;
+  const int reach = int(std::min(radius, 1e6f));
+  const int fromX = std::max(0, (pos.x - reach - grid.originX) / SpatialGrid::cellSize);
+  const int fromY = std::max(0, (pos.y - reach - grid.originY) / SpatialGrid::cellSize);
+  const int toX = std::min(grid.width - 1, (pos.x + reach - grid.originX) / SpatialGrid::cellSize);
+  const int toY = std::min(grid.height - 1, (pos.y + reach - grid.originY) / SpatialGrid::cellSize);
+  const float radiusSq = sqr(radius);
+  for (int y = fromY; y <= toY; ++y)
+    for (int x = fromX; x <= toX; ++x)
+    {
+      const size_t cell = size_t(y * grid.width + x);
+      for (uint32_t i = grid.cellStart[cell]; i < grid.cellStart[cell + 1]; ++i)
+      {
+        const SpatialGrid::Entry &entry = grid.entries[grid.cellEntries[i]];
+        if (dist_sq(entry.pos, pos) < radiusSq)
+          c(entry);
+      }
+    }
+}
+
+template<typename Callable>
+inline void query_spatial_grid(flecs::world &ecs, Callable c)
+{
+  static auto spatialGridQuery = ecs.query<const SpatialGrid>();
+
+  spatialGridQuery.each(c);
+}
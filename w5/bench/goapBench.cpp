@@ -0,0 +1,359 @@
+// Headless GOAP planner benchmark on random solvable domains
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "goapLooter.h"
+#include "goapPlanner.h"
+#include "goapScheduler.h"
+#include "goapStaticDomain.h"
+#include "htnPlanner.h"
+
+static size_t numAllocations = 0;
+
+void *operator new(size_t size)
+{
+  numAllocations++;
+  if (void *ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+struct BenchDomain
+{
+  goap::Planner planner;
+  goap::WorldState from;
+  goap::WorldState to;
+};
+
+constexpr int maxStateValue = 4;
+
+// Actions of a hidden chain are built on a walk from the start state, so the goal is always reachable,
+// everything else is random noise for the planner to sift through.
+static BenchDomain gen_domain(size_t num_vars, size_t num_actions, std::mt19937 &rng)
+{
+  BenchDomain res;
+  std::vector<std::string> stateNames;
+  for (size_t i = 0; i < num_vars; ++i)
+    stateNames.push_back("var" + std::to_string(i));
+  res.planner = goap::create_planner();
+  goap::add_states_to_planner(res.planner, stateNames);
+
+  auto rand_int = [&](int from, int to) { return std::uniform_int_distribution<int>(from, to)(rng); };
+  auto rand_var = [&]() { return size_t(rand_int(0, int(num_vars) - 1)); };
+
+  std::vector<int> state(num_vars);
+  for (int &v : state)
+    v = rand_int(0, maxStateValue);
+  const std::vector<int> startState = state;
+
+  const size_t chainLength = std::min(num_actions, size_t(8));
+  for (size_t i = 0; i < num_actions; ++i)
+  {
+    const bool onChain = i < chainLength;
+    goap::Precond precond;
+    goap::Effect effect;
+    goap::Effect additiveEffect;
+    const int numPreconds = rand_int(1, 3);
+    for (int j = 0; j < numPreconds; ++j)
+    {
+      const size_t var = rand_var();
+      precond.push_back({stateNames[var].c_str(), onChain ? state[var] : rand_int(0, maxStateValue)});
+    }
+    const int numEffects = rand_int(1, 2);
+    std::vector<int> nextState = state;
+    for (int j = 0; j < numEffects; ++j)
+    {
+      const size_t var = rand_var();
+      if (rand_int(0, 1) == 0)
+      {
+        const int val = rand_int(0, maxStateValue);
+        effect.push_back({stateNames[var].c_str(), val});
+        nextState[var] = val;
+      }
+      else
+      {
+        const int delta = nextState[var] < maxStateValue ? 1 : -1;
+        additiveEffect.push_back({stateNames[var].c_str(), delta});
+        nextState[var] += delta;
+      }
+    }
+    const std::string name = (onChain ? "chain" : "noise") + std::to_string(i);
+    goap::add_action_to_planner(res.planner, name.c_str(), float(rand_int(1, 3)), precond, effect, additiveEffect);
+    if (onChain)
+    {
+      const goap::WorldState ws = goap::apply_action(res.planner, res.planner.actions.size() - 1,
+                                                     goap::WorldState(state.begin(), state.end()));
+      state.assign(ws.begin(), ws.end());
+    }
+  }
+
+  res.from = goap::WorldState(startState.begin(), startState.end());
+  res.to = goap::WorldState(num_vars, int8_t(-1));
+  // goal constrains a few variables of where the hidden chain ends up, preferably the changed ones
+  std::vector<size_t> changedVars;
+  for (size_t i = 0; i < num_vars; ++i)
+    if (state[i] != startState[i])
+      changedVars.push_back(i);
+  const int numGoalVars = rand_int(2, 3);
+  for (int j = 0; j < numGoalVars; ++j)
+  {
+    const size_t var = changedVars.empty() ? rand_var() : changedVars[size_t(rand_int(0, int(changedVars.size()) - 1))];
+    res.to[var] = int8_t(state[var]);
+  }
+  return res;
+}
+
+struct BenchResult
+{
+  double micros = 0.0;
+  size_t expandedNodes = 0;
+  size_t allocations = 0;
+  size_t found = 0;
+  size_t unfinished = 0;
+};
+
+static void run_bench(const BenchDomain &domain, goap::SearchMode mode, size_t node_limit, BenchResult &res)
+{
+  using clock = std::chrono::steady_clock;
+  const size_t allocsBefore = numAllocations;
+  const clock::time_point start = clock::now();
+
+  goap::PlanJob job = goap::start_plan(domain.planner, domain.from, domain.to, mode);
+  goap::step_plan(job, node_limit);
+
+  res.micros += double(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count()) * 1e-3;
+  res.allocations += numAllocations - allocsBefore;
+  res.expandedNodes += job.expandedNodes;
+  res.found += job.found ? 1 : 0;
+  res.unfinished += job.done ? 0 : 1;
+}
+
+// looter from goapLooter.cpp declared at compile time too, to compare runtime and compile-time domains on the same search
+enum LooterVar : size_t
+{
+  VarEnemyVis, VarLootVis, VarNumLoot, VarHaveMelee, VarHaveRanged, VarEnemyDist, VarHealthState, VarEscaped,
+  NumLooterVars
+};
+
+namespace looter
+{
+  using namespace goap;
+
+  template<typename Precond, typename Effect, int Cost = 1>
+  struct LooterAction : StaticAction<Precond, Effect>
+  {
+    static constexpr float cost = float(Cost);
+  };
+
+  struct OpenRoom : LooterAction<Preconds<Is<VarHealthState, Healthy>>,
+                                 Effects<Set<VarEnemyVis, 1>, Set<VarLootVis, 1>, Set<VarEnemyDist, 2>>>
+  { static constexpr const char *name = "open_room"; };
+  struct Loot : LooterAction<Preconds<Is<VarHealthState, Healthy>, Is<VarLootVis, 1>, Is<VarEnemyVis, 0>>,
+                             Effects<Set<VarLootVis, 0>, Add<VarNumLoot, 1>>>
+  { static constexpr const char *name = "loot"; };
+  struct ApproachEnemy : LooterAction<Preconds<Is<VarHealthState, Healthy>, Is<VarEnemyVis, 1>>, Effects<Add<VarEnemyDist, -1>>>
+  { static constexpr const char *name = "approach_enemy"; };
+  struct FleeEnemy : LooterAction<Preconds<Is<VarHealthState, Healthy>, Is<VarEnemyVis, 1>>, Effects<Add<VarEnemyDist, 1>>>
+  { static constexpr const char *name = "flee_enemy"; };
+  struct FindMelee : LooterAction<Preconds<Is<VarHaveMelee, 0>, Is<VarHealthState, Healthy>>, Effects<Set<VarHaveMelee, 1>>>
+  { static constexpr const char *name = "find_melee"; };
+  struct FindRanged : LooterAction<Preconds<Is<VarHaveRanged, 0>, Is<VarHealthState, Healthy>>, Effects<Set<VarHaveRanged, 1>>>
+  { static constexpr const char *name = "find_ranged"; };
+  struct PatchUp : LooterAction<Preconds<Is<VarHealthState, Injured>>, Effects<Add<VarHealthState, 1>>>
+  { static constexpr const char *name = "patch_up"; };
+  struct AttackEnemy : LooterAction<Preconds<Is<VarEnemyVis, 1>, Is<VarHaveMelee, 1>, Is<VarEnemyDist, DistMelee>,
+                                             Is<VarHealthState, Healthy>>,
+                                    Effects<Set<VarEnemyVis, 0>, Add<VarHealthState, -1>>>
+  { static constexpr const char *name = "attack_enemy"; };
+  struct ShootEnemy : LooterAction<Preconds<Is<VarEnemyVis, 1>, Is<VarHaveRanged, 1>, Is<VarEnemyDist, DistRanged>,
+                                            Is<VarHealthState, Healthy>>,
+                                   Effects<Set<VarEnemyVis, 0>, Add<VarHealthState, -1>>, 5>
+  { static constexpr const char *name = "shoot_enemy"; };
+  struct Escape : LooterAction<Preconds<Is<VarHealthState, Healthy>, Is<VarNumLoot, 5>>, Effects<Set<VarEscaped, 1>>>
+  { static constexpr const char *name = "escape"; };
+
+  using Domain = StaticDomain<NumLooterVars, OpenRoom, Loot, ApproachEnemy, FleeEnemy, FindMelee, FindRanged,
+                              PatchUp, AttackEnemy, ShootEnemy, Escape>;
+};
+
+template<typename Domain>
+static void run_looter_bench(const char *name, const Domain &domain, const typename Domain::State &from,
+                             const typename Domain::State &to, size_t num_runs)
+{
+  for (goap::SearchMode mode : {goap::SearchForward, goap::SearchRegressive})
+  {
+    using clock = std::chrono::steady_clock;
+    const size_t allocsBefore = numAllocations;
+    const clock::time_point start = clock::now();
+    size_t expanded = 0;
+    size_t planLength = 0;
+    for (size_t i = 0; i < num_runs; ++i)
+    {
+      goap::BasicPlanJob<Domain> job = goap::start_plan(domain, from, to, mode);
+      goap::step_plan(job, size_t(-1));
+      expanded += job.expandedNodes;
+      planLength = job.plan.size();
+    }
+    const double micros = double(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count()) * 1e-3;
+    const double n = double(num_runs);
+    printf("%8s %11s %12.1f %10.1f %12.1f %6zu\n", name, mode == goap::SearchForward ? "forward" : "regressive",
+           micros / n, double(expanded) / n, double(numAllocations - allocsBefore) / n, planLength);
+  }
+}
+
+static void looter_bench(size_t num_runs)
+{
+  const goap::Planner runtime = goap::create_looter_planner();
+  const goap::WorldState runtimeFrom = goap::looter_start_state(runtime);
+  const goap::WorldState runtimeTo = goap::looter_goal_state(runtime);
+
+  const looter::Domain compiled;
+  const looter::Domain::State compiledFrom = {0, 1, 0, 1, 1, DistFar, Healthy, 0};
+  looter::Domain::State compiledTo = looter::Domain::any_state();
+  compiledTo[VarNumLoot] = 5;
+  compiledTo[VarEscaped] = 1;
+  compiledTo[VarHealthState] = Healthy;
+
+  printf("looter domain, %zu runs, values are per plan averages\n", num_runs);
+  printf("%8s %11s %12s %10s %12s %6s\n", "domain", "mode", "time(us)", "expanded", "allocations", "steps");
+  run_looter_bench("runtime", runtime, runtimeFrom, runtimeTo, num_runs);
+  run_looter_bench("static", compiled, compiledFrom, compiledTo, num_runs);
+
+  const htn::Domain htnDomain = htn::create_looter_domain(runtime);
+  {
+    using clock = std::chrono::steady_clock;
+    const size_t allocsBefore = numAllocations;
+    const clock::time_point start = clock::now();
+    size_t planLength = 0;
+    for (size_t i = 0; i < num_runs; ++i)
+    {
+      std::vector<goap::PlanStep> plan;
+      htn::make_plan(htnDomain, runtimeFrom, "escape_with_loot", plan);
+      planLength = plan.size();
+    }
+    const double micros = double(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count()) * 1e-3;
+    const double n = double(num_runs);
+    printf("%8s %11s %12.1f %10s %12.1f %6zu\n", "htn", "decompose", micros / n, "-",
+           double(numAllocations - allocsBefore) / n, planLength);
+  }
+  printf("\n");
+}
+
+// Many jobs sharing a budget smaller than their count: checks that a turn never goes over the budget,
+// that rotation reaches every job within num_jobs / budget turns and that every job publishes
+// the same plan it would get planned on its own.
+static bool scheduler_bench(size_t num_jobs, size_t budget_nodes)
+{
+  std::vector<BenchDomain> domains;
+  std::vector<goap::PlanJob> expected;
+  goap::PlanScheduler sched;
+  std::vector<size_t> ids;
+  for (size_t i = 0; i < num_jobs; ++i)
+  {
+    std::mt19937 rng(uint32_t(i * 7919 + 17));
+    domains.push_back(gen_domain(8, 50, rng));
+  }
+  for (const BenchDomain &domain : domains)
+  {
+    expected.push_back(goap::start_plan(domain.planner, domain.from, domain.to));
+    goap::step_plan(expected.back(), size_t(-1));
+    ids.push_back(goap::request_plan(sched, domain.planner, domain.from, domain.to));
+  }
+
+  // job ids of a fresh scheduler are handed out from 0, so they index the vectors below
+  const size_t fairTurns = (num_jobs + budget_nodes - 1) / budget_nodes;
+  std::vector<size_t> firstStepTurn(num_jobs, 0);
+  std::vector<size_t> expandedSoFar(num_jobs, 0);
+  std::vector<bool> published(num_jobs, false);
+  size_t numPublished = 0;
+  size_t overBudgetTurns = 0;
+  size_t wrongResults = 0;
+  size_t turn = 0;
+  while (numPublished < num_jobs && turn < 100000)
+  {
+    ++turn;
+    goap::process_plan_jobs(sched, budget_nodes);
+    size_t expandedThisTurn = 0;
+    auto account = [&](size_t id, size_t expanded)
+    {
+      expandedThisTurn += expanded - expandedSoFar[id];
+      expandedSoFar[id] = expanded;
+      if (expanded > 0 && firstStepTurn[id] == 0)
+        firstStepTurn[id] = turn;
+    };
+    for (size_t i = 0; i < sched.jobs.size(); ++i)
+      account(sched.jobIds[i], sched.jobs[i].expandedNodes);
+    for (size_t i = 0; i < num_jobs; ++i)
+    {
+      goap::PlanResult result;
+      if (published[i] || !goap::fetch_plan_result(sched, ids[i], result))
+        continue;
+      published[i] = true;
+      numPublished++;
+      // the search is deterministic, so the published job expanded as many nodes as the reference one
+      account(i, expected[i].expandedNodes);
+      if (firstStepTurn[i] == 0)
+        firstStepTurn[i] = turn;
+      if (result.found != expected[i].found || result.cost != expected[i].cost ||
+          result.plan.size() != expected[i].plan.size())
+        wrongResults++;
+    }
+    if (expandedThisTurn > budget_nodes)
+      overBudgetTurns++;
+  }
+  const size_t lastFirstStep = *std::max_element(firstStepTurn.begin(), firstStepTurn.end());
+  const bool ok = numPublished == num_jobs && lastFirstStep <= fairTurns && overBudgetTurns == 0 && wrongResults == 0;
+  printf("scheduler: %zu jobs, budget %zu, %zu turns, last first step on turn %zu (fair %zu), "
+         "%zu over budget, %zu of %zu published, %zu wrong -> %s\n\n",
+         num_jobs, budget_nodes, turn, lastFirstStep, fairTurns, overBudgetTurns, numPublished, num_jobs,
+         wrongResults, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main(int argc, const char **argv)
+{
+  const size_t numSeeds = argc > 1 ? size_t(std::atoi(argv[1])) : 8;
+  const size_t nodeLimit = argc > 2 ? size_t(std::atoi(argv[2])) : 20000;
+
+  const size_t varCounts[] = {4, 8, 16, 32, 64};
+  const size_t actionCounts[] = {10, 50, 100, 500, 1000};
+  const char *modeNames[] = {"forward", "regressive"};
+
+  looter_bench(numSeeds);
+  const bool schedulerOk = scheduler_bench(100, 10) && scheduler_bench(16, 1000);
+
+  printf("%d seeds per row, node limit %zu, values are per plan averages\n", int(numSeeds), nodeLimit);
+  printf("%5s %6s %11s %12s %10s %12s %6s %10s\n",
+         "vars", "acts", "mode", "time(us)", "expanded", "allocations", "found", "unfinished");
+  for (size_t numVars : varCounts)
+    for (size_t numActions : actionCounts)
+    {
+      BenchResult results[2];
+      for (size_t seed = 0; seed < numSeeds; ++seed)
+      {
+        std::mt19937 rng(uint32_t(seed * 7919 + numVars * 131 + numActions));
+        const BenchDomain domain = gen_domain(numVars, numActions, rng);
+        run_bench(domain, goap::SearchForward, nodeLimit, results[0]);
+        run_bench(domain, goap::SearchRegressive, nodeLimit, results[1]);
+      }
+      for (size_t mode = 0; mode < 2; ++mode)
+      {
+        const BenchResult &res = results[mode];
+        const double n = double(numSeeds);
+        printf("%5zu %6zu %11s %12.1f %10.1f %12.1f %6zu %10zu\n", numVars, numActions, modeNames[mode],
+               res.micros / n, double(res.expandedNodes) / n, double(res.allocations) / n,
+               res.found, res.unfinished);
+      }
+    }
+  return schedulerOk ? 0 : 1;
+}
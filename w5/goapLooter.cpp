@@ -0,0 +1,105 @@
+#include "goapLooter.h"
+
+goap::Planner goap::create_looter_planner()
+{
+  goap::Planner pl = goap::create_planner();
+
+  goap::add_states_to_planner(pl,
+      {"enemy_vis",
+       "loot_vis",
+       "num_loot",
+       "have_melee",
+       "have_ranged",
+       "enemy_dist",
+       "health_state",
+       "escaped"});
+
+  goap::add_action_to_planner(pl, "open_room", 1,
+      {{"health_state", Healthy}},
+      {{"enemy_vis", 1}, {"loot_vis", 1}, {"enemy_dist", 2}},
+      {});
+
+  goap::add_action_to_planner(pl, "loot", 1,
+      {{"health_state", Healthy}, {"loot_vis", 1}, {"enemy_vis", 0}},
+      {{"loot_vis", 0}},
+      {{"num_loot", +1}});
+
+  goap::add_action_to_planner(pl, "approach_enemy", 1,
+      {{"health_state", Healthy}, {"enemy_vis", 1}},
+      {},
+      {{"enemy_dist", -1}});
+
+  goap::add_action_to_planner(pl, "flee_enemy", 1,
+      {{"health_state", Healthy}, {"enemy_vis", 1}},
+      {},
+      {{"enemy_dist", +1}});
+
+  goap::add_action_to_planner(pl, "find_melee", 1,
+      {{"have_melee", 0}, {"health_state", Healthy}},
+      {{"have_melee", 1}},
+      {});
+
+  goap::add_action_to_planner(pl, "find_ranged", 1,
+      {{"have_ranged", 0}, {"health_state", Healthy}},
+      {{"have_ranged", 1}},
+      {});
+
+  goap::add_action_to_planner(pl, "patch_up", 1,
+      {{"health_state", Injured}},
+      {},
+      {{"health_state", +1}});
+
+  goap::add_action_to_planner(pl, "attack_enemy", 1,
+      {{"enemy_vis", 1}, {"have_melee", 1}, {"enemy_dist", DistMelee}, {"health_state", Healthy}},
+      {{"enemy_vis", 0}},
+      {{"health_state", -1}});
+
+  goap::add_action_to_planner(pl, "shoot_enemy", 5,
+      {{"enemy_vis", 1}, {"have_ranged", 1}, {"enemy_dist", DistRanged}, {"health_state", Healthy}},
+      {{"enemy_vis", 0}},
+      {{"health_state", -1}});
+
+  goap::add_action_to_planner(pl, "escape", 1,
+      {{"health_state", Healthy}, {"num_loot", 5}},
+      {{"escaped", 1}},
+      {});
+
+  return pl;
+}
+
+goap::WorldState goap::looter_start_state(const Planner &looter)
+{
+  return goap::produce_planner_worldstate(looter,
+      {{"enemy_vis", 0},
+       {"loot_vis", 1},
+       {"num_loot", 0},
+       {"have_melee", 1},
+       {"have_ranged", 1},
+       {"enemy_dist", DistFar},
+       {"health_state", Healthy},
+       {"escaped", 0}});
+}
+
+goap::WorldState goap::looter_goal_state(const Planner &looter)
+{
+  return goap::produce_planner_worldstate(looter,
+      {{"num_loot", 5}, {"escaped", 1}, {"health_state", Healthy}});
+}
+
+htn::Domain htn::create_looter_domain(const goap::Planner &looter)
+{
+  Domain res = create_domain(looter);
+  add_method(res, "escape_with_loot", {{"num_loot", 5}}, {"escape"});
+  add_method(res, "escape_with_loot", {}, {"get_loot", "escape_with_loot"});
+
+  add_method(res, "get_loot", {{"loot_vis", 1}, {"enemy_vis", 0}}, {"loot"});
+  add_method(res, "get_loot", {{"enemy_vis", 1}}, {"clear_enemy", "get_loot"});
+  add_method(res, "get_loot", {{"loot_vis", 0}}, {"open_room", "get_loot"});
+
+  add_method(res, "clear_enemy", {{"enemy_dist", DistMelee}}, {"attack_enemy", "recover"});
+  add_method(res, "clear_enemy", {}, {"approach_enemy", "clear_enemy"});
+
+  add_method(res, "recover", {{"health_state", Injured}}, {"patch_up"});
+  add_method(res, "recover", {}, {});
+  return res;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "goapPlanner.h"
+#include "htnPlanner.h"
+
+enum EnemyDist
+{
+  DistMelee = 0,
+  DistRanged,
+  DistFar
+};
+
+enum HealthState
+{
+  Dead = 0,
+  Injured,
+  Healthy
+};
+
+// Looter from the debug planner in main.cpp, shared with goap_bench so both plan on the same domain
+namespace goap
+{
+  Planner create_looter_planner();
+
+  // healthy looter next to a visible loot, armed with both weapons
+  WorldState looter_start_state(const Planner &looter);
+  // escaped healthy with five loots
+  WorldState looter_goal_state(const Planner &looter);
+};
+
+namespace htn
+{
+  // the same looter scripted as a task network, root task is "escape_with_loot"
+  Domain create_looter_domain(const goap::Planner &looter);
+};
@@ -1,4 +1,5 @@
 #include "goapPlanner.h"
+#include <cstdint>
 
 goap::Planner goap::create_planner()
 {
@@ -51,19 +52,22 @@ float goap::get_action_cost(const Planner &planner, size_t act_id)
   return planner.actions[act_id].cost;
 }
 
+bool goap::is_action_valid(const Planner &planner, size_t act, const WorldState &from)
+{
+  const Action &action = planner.actions[act];
+  bool isValidAction = true;
+  for (size_t j = 0; j < action.precondition.size() && isValidAction; ++j)
+    isValidAction &= action.precondition[j] < 0 || from[j] == action.precondition[j];
+  return isValidAction;
+}
+
 std::vector<size_t> goap::find_valid_state_transitions(const Planner &planner, const WorldState &from)
 {
   std::vector<size_t> res;
 
   for (size_t i = 0; i < planner.actions.size(); ++i)
-  {
-    const Action &action = planner.actions[i];
-    bool isValidAction = true;
-    for (size_t j = 0; j < action.precondition.size() && isValidAction; ++j)
-      isValidAction &= action.precondition[j] < 0 || from[j] == action.precondition[j];
-    if (isValidAction)
+    if (is_action_valid(planner, i, from))
       res.emplace_back(i);
-  }
   return res;
 }
 
@@ -81,3 +85,41 @@ goap::WorldState goap::apply_action(const Planner &planner, size_t act, const Wo
   return res;
 }
 
+
+bool goap::regress_action(const Planner &planner, size_t act, const WorldState &goal, WorldState &res)
+{
+  const Action &action = planner.actions[act];
+  res = goal;
+  bool contributes = false;
+  for (size_t i = 0; i < goal.size(); ++i)
+  {
+    int val = goal[i];
+    if (!action.setBitset[i])
+    {
+      contributes |= val >= 0 && action.effect[i] != 0;
+      if (val >= 0)
+      {
+        val -= action.effect[i];
+        if (val < 0) // would need a negative value before the action
+          return false;
+      }
+    }
+    else if (action.effect[i] >= 0)
+    {
+      if (val >= 0 && val != action.effect[i])
+        return false;
+      contributes |= val >= 0;
+      val = -1; // the effect takes care of it
+    }
+    if (action.precondition[i] >= 0)
+    {
+      if (val >= 0 && val != action.precondition[i])
+        return false;
+      val = action.precondition[i];
+    }
+    if (val > INT8_MAX)
+      return false;
+    res[i] = int8_t(val);
+  }
+  return contributes;
+}
@@ -5,12 +5,15 @@
 
 #include "goapWorldState.h"
 #include "goapAction.h"
+#include "goapSearch.h"
 
 namespace goap
 {
 
   struct Planner
   {
+    using State = WorldState;
+
     WorldDesc wdesc;
     std::vector<Action> actions;
     std::unordered_map<std::string, size_t> actionNames;
@@ -32,16 +35,32 @@ namespace goap
 
   float get_action_cost(const Planner &planner, size_t act_id);
 
+  bool is_action_valid(const Planner &planner, size_t act, const WorldState &from);
   std::vector<size_t> find_valid_state_transitions(const Planner &planner, const WorldState &from);
   WorldState apply_action(const Planner &planner, size_t act, const WorldState &from);
+  // goal that has to hold before act so that goal holds after it, false if act doesn't help or clobbers goal
+  bool regress_action(const Planner &planner, size_t act, const WorldState &goal, WorldState &res);
 
-  struct PlanStep
+  template<typename Callable>
+  inline void for_each_valid_action(const Planner &planner, const WorldState &from, Callable c)
   {
-    size_t action;
-    WorldState worldState;
-  };
+    for (size_t actId : find_valid_state_transitions(planner, from))
+      c(actId, apply_action(planner, actId, from));
+  }
+
+  template<typename Callable>
+  inline void for_each_regressed_action(const Planner &planner, const WorldState &goal, Callable c)
+  {
+    WorldState st;
+    for (size_t actId = 0; actId < planner.actions.size(); ++actId)
+      if (regress_action(planner, actId, goal, st))
+        c(actId, st);
+  }
+
+  using PlanStep = BasicPlanStep<WorldState>;
+  using PlanNode = BasicPlanNode<WorldState>;
+  using PlanJob = BasicPlanJob<Planner>;
 
-  float make_plan(const Planner &planner, const WorldState &from, const WorldState &to, std::vector<PlanStep> &plan);
   void print_plan(const Planner &planner, const WorldState &init, const std::vector<PlanStep> &plan);
 };
 
@@ -0,0 +1,96 @@
+#include "goapScheduler.h"
+#include <algorithm>
+#include <chrono>
+
+size_t goap::request_plan(PlanScheduler &sched, const Planner &planner, const WorldState &from, const WorldState &to,
+                          SearchMode mode)
+{
+  const size_t id = sched.nextJobId++;
+  sched.jobs.emplace_back(start_plan(planner, from, to, mode));
+  sched.jobIds.push_back(id);
+  return id;
+}
+
+static void remove_job(goap::PlanScheduler &sched, size_t idx)
+{
+  sched.jobs.erase(sched.jobs.begin() + ptrdiff_t(idx));
+  sched.jobIds.erase(sched.jobIds.begin() + ptrdiff_t(idx));
+  if (sched.nextJob > idx)
+    sched.nextJob--;
+  if (sched.nextJob >= sched.jobs.size())
+    sched.nextJob = 0;
+}
+
+void goap::cancel_plan(PlanScheduler &sched, size_t job_id)
+{
+  auto itf = std::find(sched.jobIds.begin(), sched.jobIds.end(), job_id);
+  if (itf != sched.jobIds.end())
+    remove_job(sched, size_t(itf - sched.jobIds.begin()));
+  sched.results.erase(job_id);
+}
+
+static void publish_done_jobs(goap::PlanScheduler &sched)
+{
+  for (size_t i = 0; i < sched.jobs.size();)
+  {
+    goap::PlanJob &job = sched.jobs[i];
+    if (!job.done)
+    {
+      ++i;
+      continue;
+    }
+    sched.results[sched.jobIds[i]] = goap::PlanResult{std::move(job.plan), job.cost, job.found};
+    remove_job(sched, i);
+  }
+}
+
+void goap::process_plan_jobs(PlanScheduler &sched, size_t budget_nodes)
+{
+  // hand out equal shares, budget left by finished jobs goes to the next round
+  while (budget_nodes > 0 && !sched.jobs.empty())
+  {
+    const size_t numJobs = sched.jobs.size();
+    const size_t share = std::max(budget_nodes / numJobs, size_t(1));
+    size_t numStepped = 0;
+    for (; numStepped < numJobs && budget_nodes > 0; ++numStepped)
+    {
+      PlanJob &job = sched.jobs[(sched.nextJob + numStepped) % numJobs];
+      const size_t expandedBefore = job.expandedNodes;
+      step_plan(job, std::min(share, budget_nodes));
+      budget_nodes -= std::min(job.expandedNodes - expandedBefore, budget_nodes);
+    }
+    // continue after the last stepped job, so jobs past the budget go first next time
+    sched.nextJob = (sched.nextJob + numStepped) % numJobs;
+    publish_done_jobs(sched);
+  }
+}
+
+void goap::process_plan_jobs_timed(PlanScheduler &sched, int64_t budget_micros)
+{
+  using clock = std::chrono::steady_clock;
+  const clock::time_point deadline = clock::now() + std::chrono::microseconds(budget_micros);
+  // at least one job is stepped per call, so tiny budgets still make progress
+  while (!sched.jobs.empty())
+  {
+    const int64_t left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - clock::now()).count();
+    const size_t numJobs = sched.jobs.size();
+    const int64_t share = std::max(left / int64_t(numJobs), int64_t(1));
+    size_t numStepped = 0;
+    for (; numStepped < numJobs && (numStepped == 0 || clock::now() < deadline); ++numStepped)
+      step_plan_timed(sched.jobs[(sched.nextJob + numStepped) % numJobs], share);
+    sched.nextJob = (sched.nextJob + numStepped) % numJobs;
+    publish_done_jobs(sched);
+    if (clock::now() >= deadline)
+      break;
+  }
+}
+
+bool goap::fetch_plan_result(PlanScheduler &sched, size_t job_id, PlanResult &result)
+{
+  auto itf = sched.results.find(job_id);
+  if (itf == sched.results.end())
+    return false;
+  result = std::move(itf->second);
+  sched.results.erase(itf);
+  return true;
+}
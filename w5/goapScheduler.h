@@ -0,0 +1,37 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+
+#include "goapPlanner.h"
+
+namespace goap
+{
+  struct PlanResult
+  {
+    std::vector<PlanStep> plan;
+    float cost = 0.f;
+    bool found = false;
+  };
+
+  // Shares one per-turn planning budget between all pending plan jobs
+  struct PlanScheduler
+  {
+    std::vector<PlanJob> jobs;
+    std::vector<size_t> jobIds;
+    size_t nextJobId = 0;
+    size_t nextJob = 0; // round robin start, so remainders are spread fairly
+
+    std::unordered_map<size_t, PlanResult> results;
+  };
+
+  size_t request_plan(PlanScheduler &sched, const Planner &planner, const WorldState &from, const WorldState &to,
+                      SearchMode mode = SearchForward);
+  void cancel_plan(PlanScheduler &sched, size_t job_id);
+
+  void process_plan_jobs(PlanScheduler &sched, size_t budget_nodes);
+  void process_plan_jobs_timed(PlanScheduler &sched, int64_t budget_micros);
+
+  // returns false while the plan is still in progress
+  bool fetch_plan_result(PlanScheduler &sched, size_t job_id, PlanResult &result);
+};
+
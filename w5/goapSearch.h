@@ -0,0 +1,227 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// A* over any planning domain, shared by the runtime goap::Planner and compile-time goap::StaticDomain.
+// Domain has to provide a State type indexable by variable (negative values mean "don't care") and overloads of
+//   get_action_cost(domain, act), apply_action(domain, act, state),
+//   for_each_valid_action(domain, state, c) and for_each_regressed_action(domain, goal, c),
+// the latter two calling c(act, new_state) for every action that applies.
+namespace goap
+{
+  enum SearchMode
+  {
+    SearchForward = 0, // from the full world state towards the goal
+    SearchRegressive   // from the partial goal backwards to the world state
+  };
+
+  template<typename State>
+  struct BasicPlanStep
+  {
+    size_t action;
+    State worldState;
+  };
+
+  template<typename State>
+  struct BasicPlanNode
+  {
+    State worldState;
+    State prevState;
+
+    float g = 0;
+    float h = 0;
+
+    size_t actionId;
+  };
+
+  // Resumable search, advanced by step_plan until done is set
+  template<typename Domain>
+  struct BasicPlanJob
+  {
+    using State = typename Domain::State;
+
+    const Domain *domain = nullptr;
+    SearchMode mode = SearchForward;
+    State from;
+    State to;
+
+    std::vector<BasicPlanNode<State>> openList;
+    std::vector<BasicPlanNode<State>> closedList;
+
+    std::vector<BasicPlanStep<State>> plan;
+    float cost = 0.f;
+    size_t expandedNodes = 0;
+
+    bool done = false;
+    bool found = false;
+  };
+
+  namespace internal
+  {
+    template<typename State>
+    inline float heuristic(const State &from, const State &to)
+    {
+      float cost = 0;
+      for (size_t i = 0; i < to.size(); ++i)
+        if (to[i] >= 0) // we care about it
+          cost += float(abs(to[i] - from[i]));
+      return cost;
+    }
+
+    template<typename Domain>
+    inline float job_heuristic(const BasicPlanJob<Domain> &job, const typename Domain::State &st)
+    {
+      return job.mode == SearchRegressive ? heuristic(job.from, st) : heuristic(st, job.to);
+    }
+
+    template<typename State>
+    inline void reconstruct_plan(BasicPlanNode<State> cur_node, const std::vector<BasicPlanNode<State>> &closed,
+                                 std::vector<BasicPlanStep<State>> &plan)
+    {
+      while (cur_node.actionId != size_t(-1))
+      {
+        plan.push_back({cur_node.actionId, cur_node.worldState});
+        auto itf = std::find_if(closed.begin(), closed.end(),
+                                [&](const BasicPlanNode<State> &n) { return n.worldState == cur_node.prevState; });
+        cur_node = *itf;
+      }
+      std::reverse(plan.begin(), plan.end());
+    }
+
+    // regressive search nodes chain from the start backwards to the goal, so actions come out in order
+    template<typename Domain, typename State>
+    inline void reconstruct_regressive_plan(const Domain &domain, const State &from, BasicPlanNode<State> cur_node,
+                                            const std::vector<BasicPlanNode<State>> &closed,
+                                            std::vector<BasicPlanStep<State>> &plan)
+    {
+      State ws = from;
+      while (cur_node.actionId != size_t(-1))
+      {
+        ws = apply_action(domain, cur_node.actionId, ws);
+        plan.push_back({cur_node.actionId, ws});
+        auto itf = std::find_if(closed.begin(), closed.end(),
+                                [&](const BasicPlanNode<State> &n) { return n.worldState == cur_node.prevState; });
+        cur_node = *itf;
+      }
+    }
+
+    template<typename Domain>
+    inline void add_successor(BasicPlanJob<Domain> &job, const BasicPlanNode<typename Domain::State> &cur,
+                              size_t act_id, const typename Domain::State &st)
+    {
+      using Node = BasicPlanNode<typename Domain::State>;
+      std::vector<Node> &openList = job.openList;
+      std::vector<Node> &closedList = job.closedList;
+      const float score = cur.g + get_action_cost(*job.domain, act_id);
+      auto openIt = std::find_if(openList.begin(), openList.end(), [&](const Node &n) { return st == n.worldState; });
+      auto closeIt = std::find_if(closedList.begin(), closedList.end(), [&](const Node &n) { return st == n.worldState; });
+      if (openIt != openList.end() && score < openIt->g)
+      {
+        openIt->g = score;
+        openIt->prevState = cur.worldState;
+      }
+      if (closeIt != closedList.end() && score < closeIt->g)
+      {
+        closeIt->g = score;
+        closeIt->prevState = cur.worldState;
+      }
+      if (closeIt == closedList.end() && openIt == openList.end())
+        openList.push_back({st, cur.worldState, score, job_heuristic(job, st), act_id});
+    }
+
+    // expands one node of the open list, returns true when the job is done
+    template<typename Domain>
+    inline bool expand_next_node(BasicPlanJob<Domain> &job)
+    {
+      using State = typename Domain::State;
+      using Node = BasicPlanNode<State>;
+      std::vector<Node> &openList = job.openList;
+      std::vector<Node> &closedList = job.closedList;
+      if (openList.empty())
+      {
+        job.done = true;
+        return true;
+      }
+      auto minIt = openList.begin();
+      float minF = minIt->g + minIt->h;
+      for (auto it = openList.begin(); it != openList.end(); ++it)
+        if (it->g + it->h < minF)
+        {
+          minF = it->g + it->h;
+          minIt = it;
+        }
+      Node cur = *minIt;
+      openList.erase(minIt);
+      job.expandedNodes++;
+      if (job_heuristic(job, cur.worldState) == 0) // we've reached our goal
+      {
+        if (job.mode == SearchRegressive)
+          reconstruct_regressive_plan(*job.domain, job.from, cur, closedList, job.plan);
+        else
+          reconstruct_plan(cur, closedList, job.plan);
+        job.cost = minF;
+        job.found = true;
+        job.done = true;
+        return true;
+      }
+      closedList.push_back(cur);
+      auto addSuccessor = [&](size_t act_id, const State &st) { add_successor(job, cur, act_id, st); };
+      if (job.mode == SearchRegressive)
+        for_each_regressed_action(*job.domain, cur.worldState, addSuccessor);
+      else
+        for_each_valid_action(*job.domain, cur.worldState, addSuccessor);
+      return false;
+    }
+  };
+
+  template<typename Domain>
+  inline BasicPlanJob<Domain> start_plan(const Domain &domain, const typename Domain::State &from,
+                                         const typename Domain::State &to, SearchMode mode = SearchForward)
+  {
+    BasicPlanJob<Domain> job;
+    job.domain = &domain;
+    job.mode = mode;
+    job.from = from;
+    job.to = to;
+    const typename Domain::State &root = mode == SearchRegressive ? to : from;
+    job.openList.push_back({root, root, 0, internal::heuristic(from, to), size_t(-1)});
+    return job;
+  }
+
+  // both return true when the job is done, budget is in expanded nodes or microseconds
+  template<typename Domain>
+  inline bool step_plan(BasicPlanJob<Domain> &job, size_t budget_nodes)
+  {
+    for (size_t i = 0; i < budget_nodes && !job.done; ++i)
+      internal::expand_next_node(job);
+    return job.done;
+  }
+
+  template<typename Domain>
+  inline bool step_plan_timed(BasicPlanJob<Domain> &job, int64_t budget_micros)
+  {
+    using clock = std::chrono::steady_clock;
+    if (job.done)
+      return true;
+    const clock::time_point deadline = clock::now() + std::chrono::microseconds(budget_micros);
+    // always do at least one node so that tiny budgets still progress
+    do
+      internal::expand_next_node(job);
+    while (!job.done && clock::now() < deadline);
+    return job.done;
+  }
+
+  template<typename Domain>
+  inline float make_plan(const Domain &domain, const typename Domain::State &from, const typename Domain::State &to,
+                         std::vector<BasicPlanStep<typename Domain::State>> &plan, SearchMode mode = SearchForward)
+  {
+    BasicPlanJob<Domain> job = start_plan(domain, from, to, mode);
+    step_plan(job, size_t(-1));
+    plan.insert(plan.end(), job.plan.begin(), job.plan.end());
+    return job.cost;
+  }
+};
+
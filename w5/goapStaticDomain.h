@@ -0,0 +1,189 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include "goapSearch.h"
+
+// Compile-time GOAP domains: variables are indices (usually an enum), actions are types, so the
+// state is a fixed-size array and preconditions/effects unroll into straight-line code.
+//
+//   enum LooterVar : size_t { LootVis, NumLoot, Escaped, NumLooterVars };
+//   struct Loot : goap::StaticAction<goap::Preconds<goap::Is<LootVis, 1>>,
+//                                    goap::Effects<goap::Set<LootVis, 0>, goap::Add<NumLoot, 1>>>
+//   {
+//     static constexpr const char *name = "loot";
+//     static constexpr float cost = 1.f;
+//   };
+//   using LooterDomain = goap::StaticDomain<NumLooterVars, Loot, ...>;
+namespace goap
+{
+  template<size_t Var, int Val> struct Is {};  // precondition
+  template<size_t Var, int Val> struct Set {}; // effect setting the value
+  template<size_t Var, int Val> struct Add {}; // additive effect
+
+  template<typename... Conds> struct Preconds {};
+  template<typename... Effs> struct Effects {};
+
+  namespace internal
+  {
+    template<size_t Var, int Val, typename State>
+    inline bool check_cond(Is<Var, Val>, const State &st) { return st[Var] == Val; }
+
+    template<size_t Var, int Val, typename State>
+    inline void apply_effect(Set<Var, Val>, State &st) { st[Var] = int8_t(Val); }
+
+    template<size_t Var, int Val, typename State>
+    inline void apply_effect(Add<Var, Val>, State &st) { st[Var] = int8_t(st[Var] + Val); }
+
+    // same rules as goap::regress_action for the runtime planner
+    template<size_t Var, int Val, typename State>
+    inline bool regress_effect(Set<Var, Val>, State &goal, bool &contributes)
+    {
+      if (goal[Var] < 0)
+        return true;
+      if (goal[Var] != Val)
+        return false;
+      contributes = true;
+      goal[Var] = -1; // the effect takes care of it
+      return true;
+    }
+
+    template<size_t Var, int Val, typename State>
+    inline bool regress_effect(Add<Var, Val>, State &goal, bool &contributes)
+    {
+      if (goal[Var] < 0)
+        return true;
+      const int val = goal[Var] - Val;
+      if (val < 0 || val > INT8_MAX)
+        return false;
+      contributes |= Val != 0;
+      goal[Var] = int8_t(val);
+      return true;
+    }
+
+    template<size_t Var, int Val, typename State>
+    inline bool regress_cond(Is<Var, Val>, State &goal)
+    {
+      if (goal[Var] >= 0 && goal[Var] != Val)
+        return false;
+      goal[Var] = int8_t(Val);
+      return true;
+    }
+  };
+
+  template<typename Precond, typename Effect>
+  struct StaticAction;
+
+  template<typename... Conds, typename... Effs>
+  struct StaticAction<Preconds<Conds...>, Effects<Effs...>>
+  {
+    template<typename State>
+    static bool is_valid(const State &st)
+    {
+      return (internal::check_cond(Conds{}, st) && ...);
+    }
+
+    template<typename State>
+    static State apply(State st)
+    {
+      (internal::apply_effect(Effs{}, st), ...);
+      return st;
+    }
+
+    template<typename State>
+    static bool regress(const State &goal, State &res)
+    {
+      res = goal;
+      bool contributes = false;
+      return (internal::regress_effect(Effs{}, res, contributes) && ...) &&
+             (internal::regress_cond(Conds{}, res) && ...) &&
+             contributes;
+    }
+  };
+
+  template<size_t NumVars, typename... Actions>
+  struct StaticDomain
+  {
+    using State = std::array<int8_t, NumVars>;
+
+    static constexpr size_t numActions = sizeof...(Actions);
+    static constexpr std::array<const char*, numActions> actionNames = {Actions::name...};
+    static constexpr std::array<float, numActions> actionCosts = {Actions::cost...};
+
+    // every variable "don't care" to fill in goals
+    static constexpr State any_state()
+    {
+      State res{};
+      res.fill(int8_t(-1));
+      return res;
+    }
+
+    template<typename Callable, size_t... Idx>
+    static void for_each_valid(const State &from, Callable &c, std::index_sequence<Idx...>)
+    {
+      ((Actions::is_valid(from) ? c(Idx, Actions::apply(from)) : void()), ...);
+    }
+
+    template<typename Callable, size_t... Idx>
+    static void for_each_regressed(const State &goal, Callable &c, std::index_sequence<Idx...>)
+    {
+      State st;
+      ((Actions::regress(goal, st) ? c(Idx, st) : void()), ...);
+    }
+
+    template<size_t... Idx>
+    static State apply(size_t act, const State &from, std::index_sequence<Idx...>)
+    {
+      State res = from;
+      ((act == Idx ? void(res = Actions::apply(from)) : void()), ...);
+      return res;
+    }
+  };
+
+  template<size_t NumVars, typename... Actions>
+  inline float get_action_cost(const StaticDomain<NumVars, Actions...> &, size_t act_id)
+  {
+    return StaticDomain<NumVars, Actions...>::actionCosts[act_id];
+  }
+
+  template<size_t NumVars, typename... Actions>
+  inline std::array<int8_t, NumVars> apply_action(const StaticDomain<NumVars, Actions...> &, size_t act,
+                                                  const std::array<int8_t, NumVars> &from)
+  {
+    return StaticDomain<NumVars, Actions...>::apply(act, from, std::index_sequence_for<Actions...>{});
+  }
+
+  template<size_t NumVars, typename... Actions, typename Callable>
+  inline void for_each_valid_action(const StaticDomain<NumVars, Actions...> &, const std::array<int8_t, NumVars> &from,
+                                    Callable c)
+  {
+    StaticDomain<NumVars, Actions...>::for_each_valid(from, c, std::index_sequence_for<Actions...>{});
+  }
+
+  template<size_t NumVars, typename... Actions, typename Callable>
+  inline void for_each_regressed_action(const StaticDomain<NumVars, Actions...> &,
+                                        const std::array<int8_t, NumVars> &goal, Callable c)
+  {
+    StaticDomain<NumVars, Actions...>::for_each_regressed(goal, c, std::index_sequence_for<Actions...>{});
+  }
+
+  template<size_t NumVars, typename... Actions>
+  inline void print_plan(const StaticDomain<NumVars, Actions...> &, const std::array<int8_t, NumVars> &init,
+                         const std::vector<BasicPlanStep<std::array<int8_t, NumVars>>> &plan)
+  {
+    auto print_state = [](const char *name, const std::array<int8_t, NumVars> &st)
+    {
+      printf("%15s: ", name);
+      for (int8_t val : st)
+        printf("|%2d|", val);
+      printf("\n");
+    };
+    print_state("", init);
+    for (const auto &step : plan)
+      print_state(StaticDomain<NumVars, Actions...>::actionNames[step.action], step.worldState);
+  }
+};
+
@@ -0,0 +1,98 @@
+#include "htnPlanner.h"
+
+htn::Domain htn::create_domain(const goap::Planner &planner)
+{
+  Domain res;
+  res.planner = &planner;
+  return res;
+}
+
+static size_t get_task(htn::Domain &domain, const char *name)
+{
+  auto itf = domain.taskNames.find(name);
+  if (itf != domain.taskNames.end())
+    return itf->second;
+
+  htn::Task task;
+  task.name = name;
+  auto actItf = domain.planner->actionNames.find(name);
+  if (actItf != domain.planner->actionNames.end())
+    task.action = actItf->second;
+  domain.taskNames.emplace(name, domain.tasks.size());
+  domain.tasks.emplace_back(task);
+  return domain.tasks.size() - 1;
+}
+
+void htn::add_method(Domain &domain, const char *task_name, const goap::WorldStateList &precond,
+                     const std::vector<const char*> &subtasks)
+{
+  Method method;
+  method.precondition = goap::produce_planner_worldstate(*domain.planner, precond);
+  for (const char *subtask : subtasks)
+    method.subtasks.push_back(get_task(domain, subtask));
+  const size_t taskId = get_task(domain, task_name);
+  domain.tasks[taskId].methods.emplace_back(method);
+}
+
+static bool satisfies(const goap::WorldState &state, const goap::WorldState &cond)
+{
+  for (size_t i = 0; i < cond.size(); ++i)
+    if (cond[i] >= 0 && state[i] != cond[i])
+      return false;
+  return true;
+}
+
+// pending is a stack with the next task on top, it's left untouched when decomposition fails
+static bool decompose(const htn::Domain &domain, const goap::WorldState &state, std::vector<size_t> &pending,
+                      std::vector<goap::PlanStep> &plan, size_t depth_left)
+{
+  if (pending.empty())
+    return true;
+  if (depth_left == 0)
+    return false;
+  const size_t taskId = pending.back();
+  pending.pop_back();
+  const htn::Task &task = domain.tasks[taskId];
+  if (task.action != size_t(-1))
+  {
+    if (goap::is_action_valid(*domain.planner, task.action, state))
+    {
+      plan.push_back({task.action, goap::apply_action(*domain.planner, task.action, state)});
+      if (decompose(domain, plan.back().worldState, pending, plan, depth_left - 1))
+        return true;
+      plan.pop_back();
+    }
+  }
+  else
+  {
+    for (const htn::Method &method : task.methods)
+    {
+      if (!satisfies(state, method.precondition))
+        continue;
+      const size_t pendingSize = pending.size();
+      pending.insert(pending.end(), method.subtasks.rbegin(), method.subtasks.rend());
+      if (decompose(domain, state, pending, plan, depth_left - 1))
+        return true;
+      pending.resize(pendingSize);
+    }
+  }
+  pending.push_back(taskId);
+  return false;
+}
+
+float htn::make_plan(const Domain &domain, const goap::WorldState &from, const char *root_task,
+                     std::vector<goap::PlanStep> &plan, size_t max_depth)
+{
+  auto itf = domain.taskNames.find(root_task);
+  if (itf == domain.taskNames.end())
+    return 0.f;
+  std::vector<size_t> pending = {itf->second};
+  std::vector<goap::PlanStep> res;
+  if (!decompose(domain, from, pending, res, max_depth))
+    return 0.f;
+  float cost = 0.f;
+  for (const goap::PlanStep &step : res)
+    cost += goap::get_action_cost(*domain.planner, step.action);
+  plan.insert(plan.end(), res.begin(), res.end());
+  return cost;
+}
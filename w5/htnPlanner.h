@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "goapPlanner.h"
+
+// Hierarchical task network planner over the actions of a goap::Planner: primitive tasks are planner
+// actions, compound tasks are decomposed by the first applicable of their ordered methods.
+// Produces the same goap::PlanStep lists as goap::make_plan.
+namespace htn
+{
+  struct Method
+  {
+    goap::WorldState precondition;
+    std::vector<size_t> subtasks;
+  };
+
+  struct Task
+  {
+    std::string name;
+    size_t action = size_t(-1); // primitive tasks run a planner action, compound ones have methods
+    std::vector<Method> methods;
+  };
+
+  struct Domain
+  {
+    const goap::Planner *planner = nullptr;
+    std::vector<Task> tasks;
+    std::unordered_map<std::string, size_t> taskNames;
+  };
+
+  Domain create_domain(const goap::Planner &planner);
+
+  // subtasks named as planner actions become primitive tasks, any other name is a compound task
+  void add_method(Domain &domain, const char *task_name, const goap::WorldStateList &precond,
+                  const std::vector<const char*> &subtasks);
+
+  // max_depth bounds the recursion (and so the memory), recursive methods rely on it to terminate
+  float make_plan(const Domain &domain, const goap::WorldState &from, const char *root_task,
+                  std::vector<goap::PlanStep> &plan, size_t max_depth = 256);
+};
+
@@ -6,20 +6,8 @@
 #include "roguelike.h"
 #include "dungeonGen.h"
 #include "goapPlanner.h"
-
-enum EnemyDist
-{
-  DistMelee = 0,
-  DistRanged,
-  DistFar
-};
-
-enum HealthState
-{
-  Dead = 0,
-  Injured,
-  Healthy
-};
+#include "goapLooter.h"
+#include "htnPlanner.h"
 
 static void debug_enemy_planner()
 {
@@ -109,84 +97,24 @@ static void debug_enemy_planner()
 
 static void debug_looter_planner()
 {
-  goap::Planner pl = goap::create_planner();
-
-  goap::add_states_to_planner(pl,
-      {"enemy_vis",
-       "loot_vis",
-       "num_loot",
-       "have_melee",
-       "have_ranged",
-       "enemy_dist",
-       "health_state",
-       "escaped"});
-
-  goap::add_action_to_planner(pl, "open_room", 1,
-      {{"health_state", Healthy}},
-      {{"enemy_vis", 1}, {"loot_vis", 1}, {"enemy_dist", 2}},
-      {});
-
-  goap::add_action_to_planner(pl, "loot", 1,
-      {{"health_state", Healthy}, {"loot_vis", 1}, {"enemy_vis", 0}},
-      {{"loot_vis", 0}},
-      {{"num_loot", +1}});
-
-  goap::add_action_to_planner(pl, "approach_enemy", 1,
-      {{"health_state", Healthy}, {"enemy_vis", 1}},
-      {},
-      {{"enemy_dist", -1}});
-
-  goap::add_action_to_planner(pl, "flee_enemy", 1,
-      {{"health_state", Healthy}, {"enemy_vis", 1}},
-      {},
-      {{"enemy_dist", +1}});
-
-  goap::add_action_to_planner(pl, "find_melee", 1,
-      {{"have_melee", 0}, {"health_state", Healthy}},
-      {{"have_melee", 1}},
-      {});
-
-  goap::add_action_to_planner(pl, "find_ranged", 1,
-      {{"have_ranged", 0}, {"health_state", Healthy}},
-      {{"have_ranged", 1}},
-      {});
-
-  goap::add_action_to_planner(pl, "patch_up", 1,
-      {{"health_state", Injured}},
-      {},
-      {{"health_state", +1}});
-
-  goap::add_action_to_planner(pl, "attack_enemy", 1,
-      {{"enemy_vis", 1}, {"have_melee", 1}, {"enemy_dist", DistMelee}, {"health_state", Healthy}},
-      {{"enemy_vis", 0}},
-      {{"health_state", -1}});
-
-  goap::add_action_to_planner(pl, "shoot_enemy", 5,
-      {{"enemy_vis", 1}, {"have_ranged", 1}, {"enemy_dist", DistRanged}, {"health_state", Healthy}},
-      {{"enemy_vis", 0}},
-      {{"health_state", -1}});
-
-  goap::add_action_to_planner(pl, "escape", 1,
-      {{"health_state", Healthy}, {"num_loot", 5}},
-      {{"escaped", 1}},
-      {});
-
-  goap::WorldState ws = goap::produce_planner_worldstate(pl,
-      {{"enemy_vis", 0},
-       {"loot_vis", 1},
-       {"num_loot", 0},
-       {"have_melee", 1},
-       {"have_ranged", 1},
-       {"enemy_dist", DistFar},
-       {"health_state", Healthy},
-       {"escaped", 0}});
-
-  goap::WorldState goal = goap::produce_planner_worldstate(pl,
-      {{"num_loot", 5}, {"escaped", 1}, {"health_state", Healthy}});
+  const goap::Planner pl = goap::create_looter_planner();
+  const goap::WorldState ws = goap::looter_start_state(pl);
+  const goap::WorldState goal = goap::looter_goal_state(pl);
 
   std::vector<goap::PlanStep> plan;
   goap::make_plan(pl, ws, goal, plan);
   goap::print_plan(pl, ws, plan);
+
+  std::vector<goap::PlanStep> regressivePlan;
+  goap::make_plan(pl, ws, goal, regressivePlan, goap::SearchRegressive);
+  goap::print_plan(pl, ws, regressivePlan);
+
+  // same behaviour scripted as a task network over the same actions
+  htn::Domain htnDomain = htn::create_looter_domain(pl);
+
+  std::vector<goap::PlanStep> htnPlan;
+  htn::make_plan(htnDomain, ws, "escape_with_loot", htnPlan);
+  goap::print_plan(pl, ws, htnPlan);
 }
 
 
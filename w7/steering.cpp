@@ -1,5 +1,7 @@
 #include "steering.h"
 #include "ecsTypes.h"
+#include <algorithm>
+#include <unordered_map>
 
 struct Seeker {};
 struct Pursuer {};
@@ -11,6 +13,39 @@ struct Cohesion {};
 
 struct SteerAccel { float accel = 1.f; };
 
+// Flocking neighbours bucketed by cells as big as the largest flocking radius,
+// so a steerer only looks at the cells around it.
+struct FlockGrid
+{
+  static constexpr float cellSize = 500.f;
+
+  struct Entry
+  {
+    flecs::entity entity;
+    Position pos;
+    Velocity vel;
+    bool crowds = false; // counted by separation and cohesion
+    size_t alignOrder = size_t(-1); // position in the velocity query, size_t(-1) if not counted by alignment
+  };
+  std::vector<Entry> entries; // in position query order
+  std::unordered_map<uint64_t, size_t> entryOf; // entity id -> entry
+  std::vector<std::pair<uint64_t, size_t>> cellOrder; // (cell, entry) sorted by cell
+  std::unordered_map<uint64_t, std::pair<size_t, size_t>> cells; // range in cellOrder
+  // scratch for a single steerer
+  std::vector<size_t> neighbours;
+  std::vector<std::pair<size_t, Velocity>> alignment; // (alignOrder, velocity)
+};
+
+static int flock_cell_coord(float v)
+{
+  return int(floorf(v / FlockGrid::cellSize));
+}
+
+static uint64_t flock_cell_key(int cell_x, int cell_y)
+{
+  return (uint64_t(uint32_t(cell_x)) << 32) | uint64_t(uint32_t(cell_y));
+}
+
 static flecs::entity create_separation(flecs::entity e)
 {
   return e.add<Separation>();
@@ -137,63 +172,107 @@ void steer::register_systems(flecs::world &ecs)
     });
 
   static auto otherPosQuery = ecs.query<const Position, const Hitpoints>();
+  static auto otherVelQuery = ecs.query<const Position, const Velocity>();
+  static auto flockGridQuery = ecs.query<FlockGrid>();
+
+  ecs.entity("flock_grid")
+    .set(FlockGrid{});
 
-  // separation is expensive!!!
-  ecs.system<SteerDir, const Velocity, const MoveSpeed, const Position, const Separation>()
-    .each([&](flecs::entity ent, SteerDir &sd, const Velocity &vel, const MoveSpeed &ms,
-              const Position &p, const Separation &)
+  // velocities are already updated for this frame, positions don't change until the next one
+  ecs.system<FlockGrid>()
+    .each([&](FlockGrid &grid)
     {
+      grid.entries.clear();
+      grid.entryOf.clear();
       otherPosQuery.each([&](flecs::entity oe, const Position &op, const Hitpoints &)
       {
-        if (oe == ent)
-          return;
-        constexpr float thresDist = 70.f;
-        constexpr float thresDistSq = thresDist * thresDist;
-        const float distSq = length_sq(op - p);
-        if (distSq > thresDistSq)
-          return;
-        sd += SteerDir{(p - op) * safeinv(distSq) * ms.speed * thresDist - vel};
+        grid.entryOf.emplace(oe.id(), grid.entries.size());
+        grid.entries.push_back({oe, op, Velocity{}, true});
       });
-    });
-
-  static auto otherVelQuery = ecs.query<const Position, const Velocity>();
-  ecs.system<SteerDir, const Velocity, const MoveSpeed, const Position, const Alignment>()
-    .each([&](flecs::entity ent, SteerDir &sd, const Velocity &vel, const MoveSpeed &ms,
-              const Position &p, const Alignment &)
-    {
+      // alignment summed in its own query order, which may differ from the position one
+      size_t alignOrder = 0;
       otherVelQuery.each([&](flecs::entity oe, const Position &op, const Velocity &ovel)
       {
-        if (oe == ent)
-          return;
-        constexpr float thresDist = 100.f;
-        constexpr float thresDistSq = thresDist * thresDist;
-        const float distSq = length_sq(op - p);
-        if (distSq > thresDistSq)
-          return;
-        sd += SteerDir{ovel * 0.8f};
+        const auto itf = grid.entryOf.find(oe.id());
+        if (itf == grid.entryOf.end())
+          grid.entries.push_back({oe, op, ovel, false, alignOrder});
+        else
+        {
+          grid.entries[itf->second].vel = ovel;
+          grid.entries[itf->second].alignOrder = alignOrder;
+        }
+        ++alignOrder;
       });
+      grid.cellOrder.clear();
+      for (size_t i = 0; i < grid.entries.size(); ++i)
+        grid.cellOrder.emplace_back(flock_cell_key(flock_cell_coord(grid.entries[i].pos.x),
+                                                   flock_cell_coord(grid.entries[i].pos.y)), i);
+      std::sort(grid.cellOrder.begin(), grid.cellOrder.end());
+      grid.cells.clear();
+      for (size_t i = 0; i < grid.cellOrder.size(); ++i)
+      {
+        auto itf = grid.cells.try_emplace(grid.cellOrder[i].first, i, i).first;
+        itf->second.second = i + 1;
+      }
     });
 
-  ecs.system<SteerDir, const Velocity, const MoveSpeed, const Position, const Cohesion>()
-    .each([&](flecs::entity ent, SteerDir &sd, const Velocity &vel, const MoveSpeed &ms,
-              const Position &p, const Cohesion &)
+  // separation, alignment and cohesion in one walk over the neighbours, each rule only for steerers with its tag
+  ecs.system<SteerDir, const Velocity, const MoveSpeed, const Position>()
+    .term<Separation>().or_()
+    .term<Alignment>().or_()
+    .term<Cohesion>()
+    .each([&](flecs::entity ent, SteerDir &sd, const Velocity &vel, const MoveSpeed &ms, const Position &p)
     {
-      Position avgPos{0.f, 0.f};
-      size_t count = 0;
-      otherPosQuery.each([&](flecs::entity oe, const Position &op, const Hitpoints &)
+      const bool separates = ent.has<Separation>();
+      const bool aligns = ent.has<Alignment>();
+      const bool coheres = ent.has<Cohesion>();
+      flockGridQuery.each([&](FlockGrid &grid)
       {
-        if (oe == ent)
-          return;
-        constexpr float thresDist = 500.f;
-        constexpr float thresDistSq = thresDist * thresDist;
-        const float distSq = length_sq(op - p);
-        if (distSq > thresDistSq)
-          return;
-        count++;
-        avgPos += op;
+        grid.neighbours.clear();
+        for (int y = flock_cell_coord(p.y - FlockGrid::cellSize); y <= flock_cell_coord(p.y + FlockGrid::cellSize); ++y)
+          for (int x = flock_cell_coord(p.x - FlockGrid::cellSize); x <= flock_cell_coord(p.x + FlockGrid::cellSize); ++x)
+          {
+            const auto itf = grid.cells.find(flock_cell_key(x, y));
+            if (itf == grid.cells.end())
+              continue;
+            for (size_t i = itf->second.first; i < itf->second.second; ++i)
+              grid.neighbours.push_back(grid.cellOrder[i].second);
+          }
+        // back to query order, so the sums round exactly as in separate passes
+        std::sort(grid.neighbours.begin(), grid.neighbours.end());
+
+        constexpr float sepThresDist = 70.f;
+        constexpr float sepThresDistSq = sepThresDist * sepThresDist;
+        constexpr float alignThresDistSq = 100.f * 100.f;
+        constexpr float cohThresDistSq = 500.f * 500.f;
+        grid.alignment.clear();
+        Position avgPos{0.f, 0.f};
+        size_t count = 0;
+        for (size_t idx : grid.neighbours)
+        {
+          const FlockGrid::Entry &other = grid.entries[idx];
+          if (other.entity == ent)
+            continue;
+          const float distSq = length_sq(other.pos - p);
+          if (separates && other.crowds && distSq <= sepThresDistSq)
+            sd += SteerDir{(p - other.pos) * safeinv(distSq) * ms.speed * sepThresDist - vel};
+          if (aligns && other.alignOrder != size_t(-1) && distSq <= alignThresDistSq)
+            grid.alignment.emplace_back(other.alignOrder, other.vel);
+          if (coheres && other.crowds && distSq <= cohThresDistSq)
+          {
+            count++;
+            avgPos += other.pos;
+          }
+        }
+        // alignment goes after all of separation and in velocity query order as it used to
+        std::sort(grid.alignment.begin(), grid.alignment.end(),
+                  [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+        for (const auto &ovel : grid.alignment)
+          sd += SteerDir{ovel.second * 0.8f};
+        constexpr float avgPosMult = 100.f;
+        if (coheres)
+          sd += SteerDir{normalize(avgPos * safeinv(float(count)) - p) * avgPosMult - vel};
       });
-      constexpr float avgPosMult = 100.f;
-      sd += SteerDir{normalize(avgPos * safeinv(float(count)) - p) * avgPosMult - vel};
     });
 
 }